@@ -0,0 +1,163 @@
+/*
+ * Histogram.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ */
+
+#include "Histogram.h"
+
+#include <string.h>
+
+/********************** HELPERS ************************/
+
+/*
+ * histIndex: compute bin index of a value
+ *
+ * Arguments: - histogram structure
+ * 			  - value, already offset (>= 0)
+ *
+ * Return:	  - bin index, clamped to last bin
+ */
+static uint16_t
+histIndex(const sHistogram_t * hist, uint32_t value){
+	uint32_t subCnt = 1ul << hist->subBits;
+
+	if (value < subCnt)
+		return (uint16_t)value;
+
+	// shift such that the value keeps subBits significant bits
+	uint8_t shift = (uint8_t)(31 - __builtin_clz(value) - hist->subBits + 1);
+	uint32_t idx = (uint32_t)shift * (subCnt >> 1) + (value >> shift);
+
+	return (uint16_t)((idx < hist->nBins) ? idx : hist->nBins - 1);
+}
+
+/*
+ * histUpper: highest value that falls into a bin
+ *
+ * Arguments: - histogram structure
+ * 			  - bin index
+ *
+ * Return:	  - highest equivalent value, already offset
+ */
+static uint32_t
+histUpper(const sHistogram_t * hist, uint16_t idx){
+	uint32_t subCnt = 1ul << hist->subBits;
+
+	if (idx < subCnt)
+		return idx;
+
+	uint8_t shift = (uint8_t)(idx / (subCnt >> 1) - 1);
+	uint32_t top = idx % (subCnt >> 1) + (subCnt >> 1);
+
+	return (top << shift) + (1ul << shift) - 1;
+}
+
+/*************** HISTOGRAM FUNCTIONS ********************/
+
+/*
+ * histInit: initialize a histogram with caller supplied bins
+ *
+ * Arguments: - histogram structure
+ * 			  - bin array
+ * 			  - size of bin array, use HIST_BINS to compute
+ * 			  - precision, number of sub-bucket bits (>= 1)
+ * 			  - value offset, i.e. lowest recordable value
+ *
+ * Return:	  -
+ */
+void
+histInit(sHistogram_t * hist, uint32_t * bins, uint16_t nBins, uint8_t subBits, int32_t offset){
+	hist->bins = bins;
+	hist->nBins = nBins;
+	hist->subBits = subBits;
+	hist->offset = offset;
+	histReset(hist);
+}
+
+/*
+ * histReset: clear all counts of a histogram
+ *
+ * Arguments: - histogram structure
+ *
+ * Return:	  -
+ */
+void
+histReset(sHistogram_t * hist){
+	memset(hist->bins, 0, sizeof(uint32_t) * hist->nBins);
+	hist->count = 0;
+	hist->sum = 0;
+	hist->min = INT32_MAX;
+	hist->max = INT32_MIN;
+}
+
+/*
+ * histAdd: record a value
+ *
+ * Arguments: - histogram structure
+ * 			  - value to record, values below offset count as offset
+ *
+ * Return:	  -
+ */
+void
+histAdd(sHistogram_t * hist, int32_t value){
+	uint32_t ofsVal = (value > hist->offset) ? (uint32_t)(value - hist->offset) : 0;
+
+	hist->bins[histIndex(hist, ofsVal)]++;
+	hist->count++;
+	hist->sum += value;
+	if (value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+}
+
+/*
+ * histPercentile: get value at percentile
+ *
+ * Arguments: - histogram structure
+ * 			  - percentile to query, 0-100
+ *
+ * Return:	  - highest equivalent value of the bin, clamped to min/max
+ */
+int32_t
+histPercentile(const sHistogram_t * hist, uint8_t percent){
+	if (!hist->count)
+		return 0;
+
+	// rank of the wanted entry, rounded up
+	uint32_t rank = (uint32_t)(((uint64_t)hist->count * percent + 99) / 100);
+	if (!rank)
+		rank = 1;
+
+	uint32_t cnt = 0;
+	for (uint16_t i = 0; i < hist->nBins; i++){
+		cnt += hist->bins[i];
+		if (cnt >= rank){
+			if (i == hist->nBins - 1)	// clamped values, upper bound unknown
+				return hist->max;
+			int32_t value = (int32_t)histUpper(hist, i) + hist->offset;
+			if (value > hist->max)
+				return hist->max;
+			if (value < hist->min)
+				return hist->min;
+			return value;
+		}
+	}
+	return hist->max;
+}
+
+/*
+ * histMean: get mean of recorded values
+ *
+ * Arguments: - histogram structure
+ *
+ * Return:	  - mean value, 0 if empty
+ */
+int32_t
+histMean(const sHistogram_t * hist){
+	if (!hist->count)
+		return 0;
+	return (int32_t)(hist->sum / (int64_t)hist->count);
+}
@@ -0,0 +1,41 @@
+/*
+ * Histogram.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+
+/*
+ * Log-bucketed (HDR-style) histogram with constant memory footprint.
+ * Values below 2^subBits are counted exactly, above every power of two is
+ * split into 2^(subBits-1) buckets, i.e. relative error <= 2^-(subBits-1).
+ * expBits is the highest bit a (offset) value can use, larger values clamp.
+ */
+#define HIST_BINS(subBits, expBits)	(((expBits) - (subBits) + 3) << ((subBits) - 1))
+
+/**
+  * Histogram control structure, bins are supplied by the caller
+  */
+typedef struct {
+	uint32_t * bins;		// bin counter array of nBins entries
+	uint16_t nBins;			// number of bins, see HIST_BINS
+	uint8_t  subBits;		// precision bits, 2^subBits sub-buckets
+	int32_t  offset;		// value offset, i.e. lowest recordable value
+	uint32_t count;			// total count of recorded values
+	int64_t  sum;			// sum of recorded values, for mean
+	int32_t  min;			// exact minimum recorded
+	int32_t  max;			// exact maximum recorded
+} sHistogram_t;
+
+void histInit(sHistogram_t * hist, uint32_t * bins, uint16_t nBins, uint8_t subBits, int32_t offset);
+void histReset(sHistogram_t * hist);
+void histAdd(sHistogram_t * hist, int32_t value);
+int32_t histPercentile(const sHistogram_t * hist, uint8_t percent);
+int32_t histMean(const sHistogram_t * hist);
+
+#endif /* HISTOGRAM_H_ */
@@ -8,34 +8,173 @@
 #include "LoRaMgmt.h"
 #include "main.h"				// Global includes/definitions, i.e. address, key, debug mode
 #include "MKRWAN.h"
+#include "SerialFrame.h"		// binary sniffer output
 
 #include <LoRa.h>
 #include <stdlib.h>				// ARM standard library
+#include <math.h>				// logf, exponential inter-arrival times
 
+#ifdef LORA_TRACE
+#include "LoRaTrace.h"
+static LoRaTraceStream traceSerial(loraSerial, LORA_TRACE);
+LoRaModem modem(traceSerial);	// @suppress("Abstract class cannot be instantiated")
+#else
 LoRaModem modem(loraSerial);	// @suppress("Abstract class cannot be instantiated")
+#endif
 
 #define freqPlan EU868
 #define POLL_NO		0			// How many times to poll
-#define MAXLORALEN	242			// maximum payload length 0-51 for DR0-2, 115 for DR3, 242 otherwise
 #define LORACHNMAX	16
 #define LORABUSY	-4			// error code for busy channel
 #define RESFREEDEL	40000		// ~resource freeing delay ETSI requirement air-time reduction
 #define MACHDRFTR	13			// Length in bytes of MACHDR + FHDR + FPORT + MIC
+#define MACDONEMRG	500			// time in ms after the RX2 delay until the MAC completed an uplink
+#define ACKGAIN		3			// time-to-ACK mean gain 2^-3, RFC 6298 alpha
+#define ACKVARGAIN	2			// time-to-ACK deviation gain 2^-2, RFC 6298 beta
+#define ACKVARK		4			// deviations added to the mean for the ACK timeout
+#define RETRYEXPMAX	6			// exponential retry back-off doubles at most 2^6 times
+#define RETRYDUTY	99			// off-time factor of the air time for a 1% duty cycle sub-band
+#define SLOTGUARD	20			// max delay in ms of a send after the slot start
+#define SYNCLEN		9			// T downlink, 'T', u32 start epoch, u32 epoch of the uplink, in ms
+#define RMTLISTEN	10			// check interval in ms for remote commands in class C
+
+#define HISTTSUB	4			// time histogram precision bits, <= 12.5% error
+#define HISTTEXP	26			// time histogram range, up to 2^27 us
+#define HISTAEXP	22			// arrival histogram range, up to 2^23 ms
+#define HISTSSUB	5			// RSSI/SNR histogram precision bits, exact below 32
+#define HISTSEXP	7			// RSSI/SNR histogram range, 256 values
+#define HISTRSSIOFS	-160		// lowest RSSI recorded
+#define HISTSNROFS	-32			// lowest SNR recorded
+
+#define PAYSEEDDEF	0x2545F491	// payload seed base if not configured, + dataLen
+#define LPPBLOCK	15			// size of a generated Cayenne LPP sensor block
+#define PHDRVER		0xA1		// payload header marker and version
+#define PHDRLEN		11			// payload header length, marker, test ID, sequence, time stamp
+
+#define SNIFFBUF	32			// sniffer ring buffer entries, power of 2 <= 128
+#define SNIFFBATCH	16			// max records per binary frame
+#define SNIFFAGE	1000		// max time in ms to hold records before output
+#define PERSEQJUMP	256			// max sequence step of a PER frame, larger steps are corrupted headers
+#define SNIFFFRAME	'F'			// frame type of sniffer record batches
+#define SNIFFRECLEN	12			// bytes per record in the frame
+#define FNVBASIS	2166136261ul	// FNV-1a 32 bit offset basis
+#define FNVPRIME	16777619ul		// FNV-1a 32 bit prime
+
+#define LBTSETTLE	1000		// time in us to skip after RX start, RSSI settling
+#define LBTLISTEN	5000		// time in us the channel must be clear before TX
+#define DUMBTXMAX	10000		// max time in ms to wait for the last TX done, > SF12 255 bytes at 125kHz
+
+#define SCANSETTLE	2			// time in ms to skip after a channel change, RSSI settling
+#define SCANFREE	1000		// max busy share of a suggested channel, in 0.01%
+#define SCANMSKDEF	0xFF		// channel mask if no scan is available
 
 #define MIN(a, b)	(a < b) ? a : b
 
 static uint8_t actBands = 2;	// active channels
 static int	pollcnt;			// un-conf poll retries
-static uint32_t	fcu;			// frame counter
-
-static unsigned rnd_contex;		// pseudo-random generator context (for reentrant)
+static uint32_t	fcu;			// uplink frame counter of the next uplink, tracked locally
+static uint32_t	fcd;			// downlink frame counter of the last downlink
+static bool fcuSync;			// fcu matches the modem, false after restart or join
+static bool fcdSync;			// fcd is a valid base for gap detection
+static uint32_t sendTS;			// time of the last uplink send, in ms
+static bool fcuSent;			// modem counter advanced, the MAC sent the last uplink
+static uint32_t waitMs;			// time to wait in iWait, in ms
+static uint8_t lastDR = 5;		// last data rate read from the modem, ADR starts with DR5
+static uint8_t payLen;			// payload length of the current test
+
+// LoRaWan traffic generator, one packet arrival per test
+static bool arrRun;				// arrival schedule started in this run
+static bool arrNew;				// packet of the test not sent yet
+static uint32_t arrNextTS;		// scheduled arrival of the current packet, in ms
+static uint32_t arrLastTS;		// first send of the previous packet, in ms
+static uint32_t arrRnd;			// arrival and length generator state
+static uint8_t burstLeft;		// packets left in the current burst
+static uint32_t slotTS;			// start of the first slot frame, synchronized or run start, in ms
+static uint32_t runTS;			// start of the run, for the efficiency totals, in ms
+static bool classC;				// modem listens in class C for remote commands
+static uint8_t retryCnt;		// retries of the current test
+static uint32_t retryRnd;		// retry jitter generator state
+
+static uint32_t rndState;		// payload pseudo-random generator state
+static uint32_t payCount;		// payloads generated since setup
+static uint32_t paySeed;		// generator state/counter of the last payload
+static uint32_t hdrSeq;			// payload header sequence number of the run
 static byte genbuf[MAXLORALEN];	// buffer for generated message
 
 static uint32_t startSleepTS;	// relative MC time of Sleep begin
-static uint32_t timerMillisTS;	// relative MC time for timers
+static uint64_t timerMicrosTS;	// relative MC time for TX/RX timers, in us
 static uint32_t startTestTS;	// relative MC time for test start
 static uint32_t sleepMillis;	// Time to remain in sleep
 
+// Run statistics, constant memory for any number of transmissions
+static uint32_t histTxBins[HIST_BINS(HISTTSUB, HISTTEXP)];
+static uint32_t histToRxBins[HIST_BINS(HISTTSUB, HISTTEXP)];
+static uint32_t histRxBins[HIST_BINS(HISTTSUB, HISTTEXP)];
+static uint32_t histRssiBins[HIST_BINS(HISTSSUB, HISTSEXP)];
+static uint32_t histSnrBins[HIST_BINS(HISTSSUB, HISTSEXP)];
+static uint32_t histGapBins[HIST_BINS(HISTTSUB, HISTTEXP)];
+static uint32_t histArrBins[HIST_BINS(HISTTSUB, HISTAEXP)];
+static uint32_t histLagBins[HIST_BINS(HISTTSUB, HISTAEXP)];
+static sLoRaStatistics_t stats;
+
+// Mode 1 TX chain, driven by the TX done interrupt
+static volatile bool dumbRun;	// chain active, restart TX on TX done
+static volatile bool dumbTx;	// packet in the air, TX done pending
+static volatile bool dumbPend;	// TX start failed, main loop retries
+static uint32_t dumbStartTS;	// time stamp of the current TX start, in us
+static uint64_t dumbFirstTS;	// time stamp of the first TX start, in us
+static uint32_t dumbDoneTS;		// time stamp of the last TX done, in us
+
+// Mode 1 listen before talk, the main loop checks the channel between packets
+static volatile bool lbtPend;	// next packet waits for a clear channel
+static uint32_t lbtTS;			// listen or back-off start, in us
+static uint32_t lbtWait;		// current back-off in us, 0 = listening
+static bool lbtBusy;			// current packet deferred at least once
+static uint32_t lbtBusyTS;		// first busy detection of the current packet, in us
+static uint32_t lbtRnd;			// back-off generator state
+
+// Mode 5 sniffer, records captured in the RX done interrupt
+typedef struct {
+	uint32_t timeRx;	// RX done time stamp, in us
+	uint32_t hash;		// FNV-1a hash of the payload
+	int16_t rssi;		// packet RSSI in dBm
+	int8_t snr;			// packet SNR in 0.25 dB
+	uint8_t len;		// payload length
+	bool hdr;			// test header found
+	uint16_t testId;	// header test ID
+	uint32_t seq;		// header sequence number
+} sSniffRec_t;
+
+static sSniffRec_t sniffBuf[SNIFFBUF];	// capture ring buffer
+static volatile uint8_t sniffHead;		// next record to write, interrupt
+static volatile uint8_t sniffTail;		// next record to output, main
+static volatile uint16_t sniffDrop;		// records lost on full buffer
+static bool sniffRun;					// receiver active
+static uint32_t sniffTS;				// time of the last batch output, in ms
+static uint32_t perHash;				// PER expected payload hash after the header
+
+// Mode 1 hop table, setter arguments precomputed at setup
+static long hopFreq[LORAHOPMAX];	// frequency in Hz
+static long hopBw[LORAHOPMAX];		// bandwidth in Hz
+static uint8_t hopIdx;				// next hop table entry
+static sLoRaHop_t hopCur;			// current radio settings
+
+// Mode 7 modem RF test
+static bool rfRun;					// RF test command active
+
+// Mode 8 channel scanner, EU868 default channels in chnMsk bit order
+static const uint16_t scanFreq[LORASCANCHN] = { 8681, 8683, 8685, 8671, 8673, 8675, 8677, 8679 };
+static bool scanRun;				// scan active
+static uint8_t scanIdx;				// channel scanned
+static uint32_t scanTS;				// dwell start on the channel, in ms
+static uint16_t scanMsk = SCANMSKDEF;	// mask of the last scan, for LoRaWan tests with mask 0
+
+// ABP identity table, one identity per uplink, cyclic
+static sLoRaIdentity_t ids[LORAIDMAX];
+static uint8_t idCount;				// identities in the table
+static int8_t idCur = -1;			// identity joined in the modem, -1 none
+static bool idFresh;				// joined identity not used yet
+
 static const sLoRaConfiguration_t * conf;	// Pointer to configuration entry
 static sLoRaResutls_t * trn;				// Pointer to actual entry
 static enum {	iIdle,
@@ -45,27 +184,133 @@ static enum {	iIdle,
 				iBusy,
 				iChnWait,
 				iRndWait,
+				iWait,
 				iSleep,
 			} internalState;
 
 /********************** HELPERS ************************/
 
 /*
- * generatePayload: fills a buffer with dataLen random bytes
+ * xorshift32: next value of the xorshift32 pseudo-random generator
+ *
+ * Arguments: - generator state, must not be 0
+ *
+ * Return:	  - next pseudo-random value, also the new state
+ */
+static uint32_t
+xorshift32(uint32_t * state){
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/*
+ * generateSensor: fill a Cayenne LPP block of temperature, humidity, pressure and battery
+ *
+ * Arguments: - Byte vector for the block, LPPBLOCK bytes
+ * 			  - first LPP channel to use
+ *
+ * Return:	  -
+ */
+static void
+generateSensor(byte *block, uint8_t channel){
+	uint32_t r = xorshift32(&rndState);
+	uint16_t temp = 150 + (r & 0xFF);				// 15.0 - 40.5 C, 0.1 C
+	uint8_t hum = 60 + ((r >> 8) & 0x3F);			// 30.0 - 61.5 %, 0.5 %
+	uint16_t press = 9800 + ((r >> 14) & 0x1FF);	// 980.0 - 1031.1 hPa, 0.1 hPa
+	uint16_t batt = 300 + ((r >> 23) & 0x7F);		// 3.00 - 4.27 V, 0.01 V
+
+	const byte lpp[LPPBLOCK] = {
+			channel, 0x67, (byte)(temp >> 8), (byte)temp,			// temperature
+			(byte)(channel + 1), 0x68, hum,							// humidity
+			(byte)(channel + 2), 0x73, (byte)(press >> 8), (byte)press,	// barometer
+			(byte)(channel + 3), 0x02, (byte)(batt >> 8), (byte)batt,	// analog input
+	};
+	memcpy(block, lpp, LPPBLOCK);
+}
+
+/*
+ * generatePayload: fills a buffer with dataLen bytes of the selected mode
  *
  * Arguments: - Byte vector for payload
+ * 			  - number of bytes to generate
+ * 			  - payload mode, PM_*
  *
  * Return:	  - next open position (end of buffer)
  */
 static byte *
-generatePayload(byte *payload){
-
-	for (int i=0; i < conf->dataLen; i++, payload++)
-		*payload=(byte)(rand_r(&rnd_contex) % 255);
+generatePayload(byte *payload, uint8_t dataLen, uint8_t payMode){
+	byte block[LPPBLOCK];
+	uint32_t word;
+	uint8_t len;
+
+	payCount++;
+	paySeed = (payMode == PM_COUNTER) ? payCount : rndState;
+
+	// fill word-wise, or block-wise for sensor frames, truncate the last
+	for (int i = 0; i < dataLen; i += len, payload += len){
+		len = (uint8_t)min(dataLen - i, (payMode == PM_SENSOR) ? LPPBLOCK : 4);
+
+		switch (payMode){
+		default:
+		case PM_RANDOM:
+			word = xorshift32(&rndState);
+			memcpy(payload, &word, len);
+			break;
+		case PM_COUNTER:
+			memcpy(payload, &payCount, len);
+			break;
+		case PM_PATTERN:
+			word = 0x03020100 + (uint32_t)i * 0x01010101;
+			memcpy(payload, &word, len);
+			break;
+		case PM_SENSOR:
+			generateSensor(block, (uint8_t)(i / LPPBLOCK * 4 + 1));
+			memcpy(payload, block, len);
+			break;
+		}
+	}
 
 	return payload;
 }
 
+/*
+ * payloadLen: get length of the payload to send
+ *
+ * Arguments: -
+ *
+ * Return:	  - data length, at least the header length if enabled
+ */
+static uint8_t
+payloadLen(){
+	if ((conf->confMsk & CM_PHDR) && payLen < PHDRLEN)
+		return PHDRLEN;
+	return payLen;
+}
+
+/*
+ * writeHeader: write test header in front of the payload, if enabled
+ *
+ * Arguments: - Byte vector for payload
+ *
+ * Return:	  -
+ *
+ * Layout, little endian: marker, u16 test ID, u32 sequence, u32 send time in ms
+ */
+static void
+writeHeader(byte *payload){
+	if (!(conf->confMsk & CM_PHDR))
+		return;
+
+	uint32_t ts = millis();
+	payload[0] = PHDRVER;
+	memcpy(&payload[1], &conf->testId, sizeof(conf->testId));
+	memcpy(&payload[3], &hdrSeq, sizeof(hdrSeq));
+	memcpy(&payload[7], &ts, sizeof(ts));
+}
+
 /*
  * xtoInt: Transform character to number
  *
@@ -127,6 +372,28 @@ setActiveBands(uint16_t chnMsk){
 		actBands++;
 }
 
+/*
+ * getMicros: wrap-safe 64 bit micro-second time stamp
+ *
+ * Arguments: -
+ *
+ * Return:	  - time since start in us
+ *
+ * Note: micros() wraps every ~71 minutes, the function must thus be called
+ * 		 at least once in this interval to detect the wrap, e.g. by LoRaMgmtMain
+ */
+static uint64_t
+getMicros(){
+	static uint32_t lastMicros;	// last value read
+	static uint32_t wraps;		// count of micros() wraps
+
+	uint32_t now = micros();
+	if (now < lastMicros)
+		wraps++;
+	lastMicros = now;
+	return ((uint64_t)wraps << 32) | now;
+}
+
 /*************** CALLBACK FUNCTIONS ********************/
 
 static void onMessage(size_t length, bool binary) __attribute__((unused));
@@ -159,10 +426,13 @@ onMessage(size_t length, bool binary){
  */
 static void
 onBeforeTx(){
-	timerMillisTS = millis();
+	timerMicrosTS = getMicros();
 	trn->timeTx = 0;
 	trn->timeRx = 0;
 	trn->timeToRx = 0;
+	trn->timeHost = 0;
+	trn->timeUart = 0;
+	trn->timeModem = 0;
 }
 
 /*
@@ -173,7 +443,17 @@ onBeforeTx(){
  */
 static void
 onAfterTx(){
-	trn->timeTx = millis() - timerMillisTS;
+	trn->timeTx = (uint32_t)(getMicros() - timerMicrosTS);
+
+	// Split by modem time stamps, 32 bit differences are wrap-safe
+	const _tx_times & txTimes = modem.getTxTimes();
+	trn->timeUart = txTimes.sent - txTimes.cmd;
+	trn->timeModem = txTimes.done - txTimes.sent;
+	if (trn->timeUart + trn->timeModem > trn->timeTx){	// time stamps not of this send
+		trn->timeUart = 0;
+		trn->timeModem = 0;
+	}
+	trn->timeHost = trn->timeTx - trn->timeUart - trn->timeModem;
 }
 
 /*
@@ -184,8 +464,344 @@ onAfterTx(){
  */
 static void
 onAfterRx(){
-	trn->timeToRx = millis() - timerMillisTS;
-	trn->timeRx = trn->timeToRx - trn->timeTx - conf->rxWindow1;
+	trn->timeToRx = (uint32_t)(getMicros() - timerMicrosTS);
+	trn->timeRx = trn->timeToRx - trn->timeTx - (uint32_t)conf->rxWindow1 * 1000;
+}
+
+/*
+ * setHop: switch radio to a hop table entry, only changed settings are written
+ * Arguments: - hop table index
+ *
+ * Return:	  -
+ */
+static void
+setHop(uint8_t idx){
+	const sLoRaHop_t * hop = &conf->hops[idx];
+
+	if (hop->frequency != hopCur.frequency)
+		LoRa.setFrequency(hopFreq[idx]);
+	if (hop->spreadFactor != hopCur.spreadFactor)
+		LoRa.setSpreadingFactor(hop->spreadFactor);
+	if (hop->bandWidth != hopCur.bandWidth)
+		LoRa.setSignalBandwidth(hopBw[idx]);
+	if (hop->codeRate != hopCur.codeRate)
+		LoRa.setCodingRate4(hop->codeRate);
+	hopCur = *hop;
+}
+
+/*
+ * dumbStart: start the next mode 1 TX, payload is already staged in genbuf
+ * Arguments: -
+ *
+ * Return:	  - true if started, false if the radio is still transmitting
+ */
+static bool
+dumbStart(){
+	if (!LoRa.beginPacket(conf->confMsk & CM_EXHDR)){
+		dumbPend = true;
+		return false;
+	}
+	dumbPend = false;
+	if (conf->hopCount){
+		setHop(hopIdx);	// in standby after beginPacket
+		stats.hopTx[hopIdx]++;
+		hopIdx = (uint8_t)((hopIdx + 1) % conf->hopCount);
+	}
+	writeHeader(genbuf);
+	LoRa.write(genbuf, payloadLen());
+	dumbStartTS = micros();
+	dumbTx = true;
+	LoRa.endPacket(true); // true = async / non-blocking mode, TX done interrupt
+	trn->txCount++;
+	trn->paySeed = paySeed;
+	hdrSeq++;
+	return true;
+}
+
+/*
+ * lbtListen: start listening on the channel of the next packet
+ *
+ * Arguments: - true for a new packet, false after a back-off
+ *
+ * Return:	  -
+ */
+static void
+lbtListen(bool next){
+	if (next && conf->hopCount)
+		setHop(hopIdx);	// listen where the packet goes, dumbStart skips unchanged settings
+	LoRa.receive();
+	lbtTS = micros();
+	lbtWait = 0;
+	lbtPend = true;
+}
+
+/*
+ * lbtCheck: sample the channel, start the packet if clear or back-off if busy
+ *
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+static void
+lbtCheck(){
+	uint32_t now = micros();
+	if (lbtWait){
+		if (now - lbtTS >= lbtWait)
+			lbtListen(false);
+		return;
+	}
+	if (now - lbtTS < LBTSETTLE)
+		return;
+
+	if (LoRa.rssi() >= conf->busyLevel){
+		if (!lbtBusy){
+			lbtBusy = true;
+			lbtBusyTS = now;
+			stats.lbtFrames++;
+		}
+		stats.lbtDefer++;
+		LoRa.idle();
+		lbtWait = xorshift32(&lbtRnd) % ((uint32_t)conf->lbtBackoff * 1000 + 1) + 1;
+		lbtTS = now;
+		return;
+	}
+	if (now - lbtTS < LBTSETTLE + LBTLISTEN)
+		return;
+
+	// clear channel
+	if (lbtBusy){
+		stats.lbtBusyTime += now - lbtBusyTS;
+		lbtBusy = false;
+	}
+	lbtPend = false;
+	LoRa.idle();
+	if (dumbStart() && stats.timeTx.count)	// not for the first packet
+		histAdd(&stats.txGap, (int32_t)(dumbStartTS - dumbDoneTS));
+}
+
+/*
+ * onDumbTxDone: Callback function for LoRa TX done, interrupt context
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+static void
+onDumbTxDone(){
+	uint32_t doneTS = micros();
+	uint32_t air = doneTS - dumbStartTS;
+	stats.airTime += air;
+	histAdd(&stats.timeTx, (int32_t)air);
+	dumbTx = false;
+
+	if (!dumbRun)
+		return;
+
+	if (conf->confMsk & CM_LBT){
+		dumbDoneTS = doneTS;
+		lbtListen(true);	// main loop starts the packet on a clear channel
+		return;
+	}
+
+	if (dumbStart())
+		histAdd(&stats.txGap, (int32_t)(dumbStartTS - doneTS));
+}
+
+
+/*
+ * onSniffRx: Callback function for LoRa RX done, interrupt context
+ * Arguments: - received payload size
+ *
+ * Return:	  -
+ */
+static void
+onSniffRx(int packetSize){
+	uint32_t rxTS = micros();
+	uint32_t hash = FNVBASIS;
+	bool all = (conf->mode != 6);	// PER checks the payload after the header only
+	uint8_t hdr[PHDRLEN];
+	int i = 0;
+	for (; LoRa.available(); i++){
+		uint8_t c = (uint8_t)LoRa.read();
+		if (i < PHDRLEN)
+			hdr[i] = c;
+		if (all || i >= PHDRLEN)
+			hash = (hash ^ c) * FNVPRIME;
+	}
+
+	uint8_t head = sniffHead;
+	if ((uint8_t)(head - sniffTail) >= SNIFFBUF){
+		sniffDrop++;
+		return;
+	}
+
+	sSniffRec_t * rec = &sniffBuf[head % SNIFFBUF];
+	rec->timeRx = rxTS;
+	rec->hash = hash;
+	rec->rssi = (int16_t)LoRa.packetRssi();
+	rec->snr = (int8_t)(LoRa.packetSnr() * 4);
+	rec->len = (uint8_t)packetSize;
+	rec->hdr = (i >= PHDRLEN && hdr[0] == PHDRVER);
+	if (rec->hdr){
+		memcpy(&rec->testId, &hdr[1], sizeof(rec->testId));
+		memcpy(&rec->seq, &hdr[3], sizeof(rec->seq));
+	}
+	sniffHead = head + 1;
+}
+
+/*
+ * sniffFlush: write a batch of captured records as binary frame
+ * Arguments: -
+ *
+ * Return:	  - number of records written
+ *
+ * Frame payload, little endian: u16 dropped records since start, then per
+ * record u32 RX time in us, u32 hash, i16 RSSI, i8 SNR in 0.25dB, u8 length
+ */
+static uint8_t
+sniffFlush(){
+	uint8_t buf[2 + SNIFFBATCH * SNIFFRECLEN];
+	uint16_t drop = sniffDrop;
+	uint8_t cnt = 0;
+
+	memcpy(buf, &drop, sizeof(drop));
+	while (sniffTail != sniffHead && cnt < SNIFFBATCH){
+		const sSniffRec_t * rec = &sniffBuf[sniffTail % SNIFFBUF];
+		uint8_t * pos = &buf[2 + cnt * SNIFFRECLEN];
+		memcpy(&pos[0], &rec->timeRx, 4);
+		memcpy(&pos[4], &rec->hash, 4);
+		memcpy(&pos[8], &rec->rssi, 2);
+		pos[10] = (uint8_t)rec->snr;
+		pos[11] = rec->len;
+
+		trn->txCount++;
+		trn->rxRssi = (int8_t)((rec->rssi < -128) ? -128 : rec->rssi);
+		trn->rxSnr = (int8_t)(rec->snr / 4);
+		histAdd(&stats.rxRssi, rec->rssi);
+		histAdd(&stats.rxSnr, rec->snr / 4);
+		sniffTail = sniffTail + 1;
+		cnt++;
+	}
+
+	if (cnt)
+		frameWrite(debugSerial, SNIFFFRAME, buf, (uint8_t)(2 + cnt * SNIFFRECLEN));
+	sniffTS = millis();
+	return cnt;
+}
+
+/*
+ * perCount: account captured records to the PER counters of their test ID
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+static void
+perCount(){
+	while (sniffTail != sniffHead){
+		const sSniffRec_t * rec = &sniffBuf[sniffTail % SNIFFBUF];
+
+		trn->txCount++;
+		histAdd(&stats.rxRssi, rec->rssi);
+		histAdd(&stats.rxSnr, rec->snr / 4);
+
+		if (!rec->hdr)
+			stats.perNoHdr++;
+		else {
+			// without CRC, only intact frames with a plausible sequence open or advance entries
+			bool intact = (rec->len == payloadLen() && rec->hash == perHash);
+
+			// find latest entry of the test ID, new entry if none or on TX restart
+			sLoRaPer_t * per = NULL;
+			for (int i = stats.perCount - 1; i >= 0; i--)
+				if (stats.per[i].testId == rec->testId){
+					per = &stats.per[i];
+					break;
+				}
+			if (intact && stats.perCount < LORAPERMAX
+					&& ((!per && (!stats.perCount || rec->seq < PERSEQJUMP))
+						|| (per && rec->seq < per->lastSeq && rec->seq < PERSEQJUMP))){
+				per = &stats.per[stats.perCount++];
+				memset(per, 0, sizeof(sLoRaPer_t));
+				per->testId = rec->testId;
+				per->lastSeq = rec->seq;
+			}
+			else if (per && (rec->seq < per->lastSeq || rec->seq - per->lastSeq > PERSEQJUMP))
+				intact = false;	// corrupted sequence number
+			else if (intact && per && rec->seq == per->lastSeq && per->received)
+				per->duplicates++;
+
+			if (per){
+				if (intact && rec->seq > per->lastSeq)
+					per->lastSeq = rec->seq;
+				per->received++;
+				if (!intact)
+					per->corrupted++;
+				per->rssiSum += rec->rssi;
+				per->snrSum += rec->snr / 4;
+			}
+			else
+				stats.perNoHdr++;	// table full
+		}
+		sniffTail = sniffTail + 1;
+	}
+}
+
+/*
+ * scanChannel: tune the receiver to a scan channel and restart the dwell time
+ *
+ * Arguments: - channel index
+ *
+ * Return:	  -
+ */
+static void
+scanChannel(uint8_t idx){
+	LoRa.idle();
+	LoRa.setFrequency((long)scanFreq[idx] * 100000);
+	LoRa.receive();
+	scanTS = millis();
+}
+
+/*
+ * scanMask: suggest a channel mask from the scan counters
+ *
+ * Arguments: -
+ *
+ * Return:	  - mask of channels busy at most SCANFREE, the least busy if none,
+ * 				SCANMSKDEF if nothing was scanned
+ */
+static uint16_t
+scanMask(){
+	uint16_t msk = 0;
+	uint8_t best = 0;
+	uint32_t bestOcc = UINT32_MAX;
+	for (uint8_t i = 0; i < LORASCANCHN; i++){
+		const sLoRaScan_t * chn = &stats.scan[i];
+		if (!chn->samples)
+			continue;
+		uint32_t occ = (uint32_t)((uint64_t)chn->busy * 10000 / chn->samples);
+		if (occ <= SCANFREE)
+			msk |= 1 << i;
+		if (occ < bestOcc){
+			bestOcc = occ;
+			best = i;
+		}
+	}
+	if (!msk && bestOcc != UINT32_MAX)
+		msk = 1 << best;
+	return (msk) ? msk : SCANMSKDEF;
+}
+
+/*
+ * recordRx: add RX timing and signal quality to the run statistics
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+static void
+recordRx(){
+	histAdd(&stats.timeToRx, (int32_t)trn->timeToRx);
+	histAdd(&stats.timeRx, (int32_t)trn->timeRx);
+	histAdd(&stats.rxRssi, modem.getRSSI());
+	histAdd(&stats.rxSnr, modem.getSNR());
 }
 
 /*
@@ -206,6 +822,19 @@ computeAirTime(uint8_t dataLen, uint8_t dataRate){
 	return (uint32_t)dataLen * 8000l / dataRates[MIN(dataRate, 5)];
 }
 
+/*
+ * txPwrDbm: convert power index to dBm
+ *
+ * Arguments: - txPwr index 0-5, 0 = 20 dBm with PA boost
+ *
+ * Return:	  - power in dBm
+ */
+static int
+txPwrDbm(uint8_t txPwr){
+	static const int8_t pwrDbm[] = { 20, 14, 11, 8, 5, 2 };
+	return (txPwr <= 5) ? pwrDbm[txPwr] : 0;
+}
+
 /*
  * setTxPwr: set power index on modem
  *
@@ -216,79 +845,428 @@ computeAirTime(uint8_t dataLen, uint8_t dataRate){
  */
 static int
 setTxPwr(uint8_t mode, uint8_t txPwr){
-	if (mode == 1){
-		// Transform the powerIndex to power in dBm
-		int npwr = 0;
-		switch (txPwr) {
-		case 1 : npwr = 14;
-				break;
-		case 2 : npwr = 11;
-				break;
-		case 3 : npwr = 8;
-				break;
-		case 4 : npwr = 5;
-				break;
-		case 5 : npwr = 2;
-				break;
-		case 0 : LoRa.setTxPower(20, PA_OUTPUT_PA_BOOST_PIN); // MAX level
-				return 0;
+	if (MD_LORA(mode)){
+		if (txPwr == 0){
+			LoRa.setTxPower(txPwrDbm(txPwr), PA_OUTPUT_PA_BOOST_PIN); // MAX level
+			return 0;
 		}
-		LoRa.setTxPower(npwr, PA_OUTPUT_RFO_PIN); // MAX RFO level
+		LoRa.setTxPower(txPwrDbm(txPwr), PA_OUTPUT_RFO_PIN); // MAX RFO level
 		return 0;
 	}
-	else if (mode > 1)
+	else if (MD_LORAWAN(mode))
 		return modem.power((txPwr == 0)? PABOOST : RFO, txPwr) ? 0 : -1;
 	return 0;
 }
 
 /*
- * getChannels:
+ * getChannels:
+ *
+ * Arguments: - pointer to channel enable bit mask to fill, 0 off, 1 on
+ *
+ * Return:	  - return 0 if OK, -1 if error
+ */
+static int
+getChannels(uint16_t * chnMsk){ // TODO: for now only EU868
+
+	*chnMsk = 0;
+	int length = modem.getChannelMaskSize(freqPlan);
+	String mask = modem.getChannelMask();
+
+	for (int i=0; i < min(length * 4, LORACHNMAX / 4); i++)
+	  *chnMsk |= (uint16_t)xtoInt(mask.c_str()[i]) << (4*(3-i));
+
+	return (0 == *chnMsk) * -1; // error if mask is empty!
+}
+
+/*
+ * setChannels: set the Channel-Mask and the wanted data rate
+ *
+ * Arguments: - pointer to channel enable bit mask to use, 0 off, 1 on
+ * 			  - dataRate for test start, (disables ADR)
+ *
+ * Return:	  - return 0 if OK, -1 if error
+ */
+static int
+setChannels(uint16_t chnMsk, uint8_t dataRate) {
+
+	bool ret = true;
+	uint16_t channelsMask[6] = {0};
+
+	channelsMask[0] = chnMsk;
+
+	modem.setMask(channelsMask);
+	ret &= modem.sendMask();
+	if (dataRate == 255){
+		ret &= modem.dataRate(5);
+		ret &= modem.setADR(true);
+	}
+	else {
+		ret &= modem.setADR(false);
+		ret &= modem.dataRate(dataRate);
+	}
+
+	return !ret * -1;
+}
+
+/*
+ * hexKey: convert binary key to a terminated upper case hex string
+ *
+ * Arguments: - destination string, 2*len+1 chars
+ * 			  - binary key
+ * 			  - length of key in bytes
+ *
+ * Return:	  -
+ */
+static void
+hexKey(char * dst, const uint8_t * src, uint8_t len){
+	static const char hex[] = "0123456789ABCDEF";
+	while (len--){
+		*dst++ = hex[*src >> 4];
+		*dst++ = hex[*src++ & 0x0F];
+	}
+	*dst = '\0';
+}
+
+/*
+ * idJoin: join with an identity of the ABP identity table and restore its frame counter
+ *
+ * Arguments: - identity index
+ *
+ * Return:	  returns 0 if successful, else -1
+ */
+static int
+idJoin(uint8_t idx){
+	const sLoRaIdentity_t * id = &ids[idx];
+	char devAddr[9], nwkSKey[33], appSKey[33];
+	hexKey(devAddr, id->devAddr, sizeof(id->devAddr));
+	hexKey(nwkSKey, id->nwkSKey, sizeof(id->nwkSKey));
+	hexKey(appSKey, id->appSKey, sizeof(id->appSKey));
+
+	idCur = idx;
+	idFresh = true;
+	fcdSync = false;
+	if (!modem.joinABP(devAddr, nwkSKey, appSKey))
+		return -1;
+	fcu = id->fcu;
+	fcuSync = modem.setFCU(fcu);
+	return !fcuSync * -1;
+}
+
+/*
+ * idActive: get identity used for the uplinks
+ *
+ * Arguments: -
+ *
+ * Return:	  pointer to the identity, NULL if the configured keys are used
+ */
+static sLoRaIdentity_t *
+idActive(){
+	return (idCount && idCur >= 0 && !(conf->confMsk & CM_OTAA)) ? &ids[idCur] : NULL;
+}
+
+/*
+ * fcUplink: track an uplink in the local frame counters
+ *
+ * Arguments: - duration of the send command, in ms
+ *
+ * Return:	  -
+ */
+static void
+fcUplink(uint32_t cmdMs){
+	sendTS = millis();
+	fcuSent = false;
+	// the modem may reply before the frame is on air, count air time only within the command
+	uint32_t air = computeAirTime(payloadLen(), (conf->dataRate <= 5) ? conf->dataRate : lastDR);
+	trn->timeAir += MIN(air, cmdMs);
+	fcu++;
+	sLoRaIdentity_t * id = idActive();
+	if (id)
+		id->fcu = fcu;
+	stats.fcu = fcu;
+}
+
+/*
+ * fcDownlink: track a received downlink, count the gap to the previous as lost
+ *
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+static void
+fcDownlink(){
+	uint32_t nfcd = modem.getFCD();
+	if (fcdSync && nfcd > fcd + 1)
+		stats.fcdLost += nfcd - fcd - 1;
+	fcd = nfcd;
+	fcdSync = true;
+	stats.fcd = fcd;
+	stats.fcdRx++;
+	trn->rxCount++;
+}
+
+/*
+ * ackEst: get time-to-ACK estimator of the last uplink
+ *
+ * Arguments: -
+ *
+ * Return:	  - estimator of the uplink data rate
+ */
+static sLoRaAckEst_t *
+ackEst(){
+	return &stats.ackEst[(trn->txDR < LORAACKDR) ? trn->txDR : LORAACKDR-1];
+}
+
+/*
+ * ackTimeout: time after TX done the ACK is expected by, mean + 4 deviations
+ *
+ * Arguments: - estimator
+ * 			  - upper limit, time the MAC completes the uplink for sure
+ *
+ * Return:	  - timeout in ms
+ */
+static uint32_t
+ackTimeout(const sLoRaAckEst_t * est, uint32_t limit){
+	if (!est->srtt)
+		return limit;	// nothing learned, expect both RX windows
+	uint32_t rto = (est->srtt >> ACKGAIN) + ACKVARK * (est->rttvar >> ACKVARGAIN);
+	if (rto > limit)
+		rto = limit;
+	return (rto > conf->rxWindow1) ? rto : conf->rxWindow1;
+}
+
+/*
+ * ackSample: update the time-to-ACK estimator with a measured acknowledgment
+ *
+ * Arguments: - estimator
+ * 			  - time from TX done to ACK, in ms
+ *
+ * Return:	  -
+ */
+static void
+ackSample(sLoRaAckEst_t * est, uint32_t ms){
+	est->samples++;
+	if (!est->srtt){
+		est->srtt = ms << ACKGAIN;
+		est->rttvar = (ms / 2) << ACKVARGAIN;
+		return;
+	}
+	// Jacobson/Karels in fixed point, srtt scaled by 8, rttvar by 4
+	int32_t err = (int32_t)ms - (int32_t)(est->srtt >> ACKGAIN);
+	est->srtt += err;
+	if (err < 0)
+		err = -err;
+	est->rttvar += err - (est->rttvar >> ACKVARGAIN);
+	if (!est->srtt)
+		est->srtt = 1;
+}
+
+/*
+ * retryBackoff: back-off before retrying a failed test, by configured policy
+ *
+ * Arguments: -
+ *
+ * Return:	  - time to wait in ms
+ */
+static uint32_t
+retryBackoff(){
+	uint32_t ms = conf->retryDelay;
+
+	switch (conf->retryPolicy){
+	default:
+	case RP_NONE:
+		return 0;
+	case RP_FIXED:
+		return ms;
+	case RP_EXP:
+		// equal jitter, random in the upper half of the doubled delay
+		ms <<= (retryCnt - 1 < RETRYEXPMAX) ? retryCnt - 1 : RETRYEXPMAX;
+		return ms / 2 + xorshift32(&retryRnd) % (ms / 2 + 1);
+	case RP_DUTY:
+		{
+			// the sub-band of the failed uplink is closed for the off-time
+			uint32_t off = computeAirTime(payloadLen(), trn->txDR) * RETRYDUTY;
+			return (off > ms) ? off : ms;
+		}
+	}
+}
+
+/*
+ * arrivalGap: draw the time from the previous to the next packet arrival
+ *
+ * Arguments: - configuration
+ *
+ * Return:	  - inter-arrival time in ms
+ */
+static uint32_t
+arrivalGap(const sLoRaConfiguration_t * newConf){
+	uint32_t mean = (uint32_t)newConf->arrPeriod * 100;
+
+	switch (newConf->arrival){
+	default:
+	case AP_NONE:
+		return 0;
+	case AP_PERIODIC:
+		{
+			uint32_t jit = mean * newConf->arrJitter / 100;
+			return mean - jit + xorshift32(&arrRnd) % (2 * jit + 1);
+		}
+	case AP_BURST:
+		if (burstLeft){
+			burstLeft--;
+			return 0;	// back-to-back within a burst
+		}
+		burstLeft = newConf->burstLen - 1;
+		// fall-through
+		// @suppress("No break at end of case")
+	case AP_POISSON:
+		{
+			// inverse transform, uniform in (0,1]
+			float u = (float)((xorshift32(&arrRnd) >> 8) + 1) / (float)(1ul << 24);
+			return (uint32_t)(-logf(u) * (float)mean);
+		}
+	}
+}
+
+/*
+ * arrivalLen: draw the payload length of a new packet
+ *
+ * Arguments: - configuration
+ *
+ * Return:	  - payload length
+ */
+static uint8_t
+arrivalLen(const sLoRaConfiguration_t * newConf){
+	uint8_t lo = newConf->lenMin, hi = newConf->dataLen;
+	if (lo >= hi)
+		return hi;
+
+	switch (newConf->lenDist){
+	default:
+	case LD_FIXED:
+		return hi;
+	case LD_UNIFORM:
+		return (uint8_t)(lo + xorshift32(&arrRnd) % (hi - lo + 1));
+	case LD_BIMODAL:
+		return (xorshift32(&arrRnd) & 1) ? hi : lo;
+	}
+}
+
+/*
+ * arrivalNext: schedule a new packet, wait until its arrival
+ *
+ * Arguments: - configuration
+ *
+ * Return:	  -
+ */
+static void
+arrivalNext(const sLoRaConfiguration_t * newConf){
+	uint32_t now = millis();
+
+	payLen = arrivalLen(newConf);
+	arrNew = true;
+	if (newConf->arrival == AP_NONE)
+		return;
+
+	if (!arrRun){	// first packet of the run arrives now
+		arrRun = true;
+		arrNextTS = now;
+		burstLeft = 0;
+		(void)arrivalGap(newConf);	// start the first burst
+	}
+	else
+		arrNextTS += arrivalGap(newConf);
+
+	// open loop, a packet arriving while busy is sent right away and lags
+	if ((int32_t)(arrNextTS - now) > 0){
+		waitMs = arrNextTS - now;
+		internalState = iWait;
+	}
+}
+
+/*
+ * arrivalSent: record the first send of a packet, after the send command completed
+ *
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+static void
+arrivalSent(){
+	uint32_t now = millis() - trn->timeTx / 1000;	// send command start
+
+	if (!arrNew)
+		return;	// retry or poll of the same packet
+	arrNew = false;
+	if (arrLastTS)
+		histAdd(&stats.arrGap, (int32_t)(now - arrLastTS));
+	arrLastTS = now;
+	if (conf->arrival != AP_NONE)
+		histAdd(&stats.arrLag, (int32_t)(now - arrNextTS));
+}
+
+/*
+ * slotWait: time until the slot of the node, slotted mode
  *
- * Arguments: - pointer to channel enable bit mask to fill, 0 off, 1 on
+ * Arguments: -
  *
- * Return:	  - return 0 if OK, -1 if error
+ * Return:	  - time to wait in ms, 0 = send now
  */
-static int
-getChannels(uint16_t * chnMsk){ // TODO: for now only EU868
-
-	*chnMsk = 0;
-	int length = modem.getChannelMaskSize(freqPlan);
-	const char * mask = modem.getChannelMask().c_str();
-
-	for (int i=0; i < min(length * 4, LORACHNMAX / 4); i++)
-	  *chnMsk |= (uint16_t)xtoInt(mask[i]) << (4*(3-i));
-
-	return (0 == *chnMsk) * -1; // error if mask is empty!
+static uint32_t
+slotWait(){
+	if (!conf->slotLen)
+		return 0;	// pure ALOHA
+
+	uint32_t frame = (uint32_t)conf->slotLen * conf->slotCount;
+	uint32_t first = slotTS + (uint32_t)conf->slotLen * (conf->slotIdx % conf->slotCount);
+	uint32_t now = millis();
+
+	if ((int32_t)(first - now) > 0)
+		return first - now;
+	uint32_t pos = (now - first) % frame;
+	return (pos < SLOTGUARD) ? 0 : frame - pos;
 }
 
 /*
- * setChannels: set the Channel-Mask and the wanted data rate
+ * remoteDone: remote command received, back to class A for the test
  *
- * Arguments: - pointer to channel enable bit mask to use, 0 off, 1 on
- * 			  - dataRate for test start, (disables ADR)
+ * Arguments: - return value of the command
  *
- * Return:	  - return 0 if OK, -1 if error
+ * Return:	  - return value, -1 if the class switch failed
  */
 static int
-setChannels(uint16_t chnMsk, uint8_t dataRate) {
-
-	bool ret = true;
-	uint16_t channelsMask[6] = {0};
-
-	channelsMask[0] = chnMsk;
-
-	modem.setMask(channelsMask);
-	ret &= modem.sendMask();
-	if (dataRate == 255){
-		ret &= modem.dataRate(5);
-		ret &= modem.setADR(true);
-	}
-	else {
-		ret &= modem.setADR(false);
-		ret &= modem.dataRate(dataRate);
+remoteDone(int ret){
+	internalState = iIdle;
+	if (classC){
+		classC = false;
+		if (!modem.configureClass(CLASS_A))
+			return -1;
 	}
+	return ret;
+}
 
-	return !ret * -1;
+/*
+ * remoteSync: synchronize the start to the epoch of a T downlink
+ *
+ * Arguments: - downlink payload, SYNCLEN bytes
+ * 			  - local time of the second epoch, in ms
+ *
+ * Return:	  -
+ */
+static void
+remoteSync(const uint8_t * rcv, uint32_t anchorTS){
+	uint32_t start = (uint32_t)rcv[1] | (uint32_t)rcv[2] << 8
+			| (uint32_t)rcv[3] << 16 | (uint32_t)rcv[4] << 24;
+	uint32_t upl = (uint32_t)rcv[5] | (uint32_t)rcv[6] << 8
+			| (uint32_t)rcv[7] << 16 | (uint32_t)rcv[8] << 24;
+
+	// epochs are in network time, the uplink that opened the RX window anchors them locally
+	slotTS = anchorTS + (start - upl);
+	stats.synced = 1;
+	stats.syncDelay = (int32_t)(slotTS - millis());
+	if (stats.syncDelay > 0){
+		waitMs = (uint32_t)stats.syncDelay;
+		internalState = iWait;
+	}
 }
 
 /*
@@ -300,8 +1278,13 @@ setChannels(uint16_t chnMsk, uint8_t dataRate) {
  */
 static int
 loRaJoin(const sLoRaConfiguration_t * newConf){
+	// counters restart or change with the session, resync at the next uplink
+	fcuSync = false;
+	fcdSync = false;
 	if (newConf->confMsk & CM_OTAA)
 		return !modem.joinOTAA(newConf->appEui, newConf->appKey) * -1;
+	else if (idCount)	// identity table replaces the configured keys, next identity
+		return idJoin((uint8_t)((idCur + 1) % idCount));
 	else
 		return !modem.joinABP(newConf->devAddr, newConf->nwkSKey, newConf->appSKey) * -1;
 }
@@ -322,6 +1305,10 @@ setupLoRaWan(const sLoRaConfiguration_t * newConf){
 	};
 
 	int ret = 0;
+	if (classC){	// stopped while listening for remote commands
+		ret |= !modem.configureClass(CLASS_A);
+		classC = false;
+	}
 	ret |= !modem.dutyCycle(newConf->confMsk & CM_DTYCL); // switch off the duty cycle
 	ret |= !modem.setADR(false);	// disable ADR by default
 
@@ -358,6 +1345,13 @@ setupLoRaWan(const sLoRaConfiguration_t * newConf){
 static int
 setupDumb(const sLoRaConfiguration_t * newConf){
 
+	dumbRun = false;
+	dumbTx = false;
+	dumbPend = false;
+	lbtPend = false;
+	lbtBusy = false;
+	sniffRun = false;
+	scanRun = false;
 	modem.dumb();
 
 	// Configure LoRa module to transmit and receive at 915MHz (915*10^6)
@@ -391,9 +1385,50 @@ setupDumb(const sLoRaConfiguration_t * newConf){
 	else
 		LoRa.disableCrc();
 
+	// precompute hop settings, a hop only writes what changes
+	hopCur.frequency = newConf->frequency;
+	hopCur.spreadFactor = newConf->spreadFactor;
+	hopCur.bandWidth = newConf->bandWidth;
+	hopCur.codeRate = newConf->codeRate;
+	hopIdx = 0;
+	for (int i = 0; i < newConf->hopCount; i++){
+		hopFreq[i] = (long)newConf->hops[i].frequency * 100000;
+		hopBw[i] = (long)newConf->hops[i].bandWidth * 1000;
+	}
+
+	// LBT back-off generator, seeded from the radio's wideband noise to differ among nodes
+	lbtRnd = ((uint32_t)LoRa.random() << 24 | (uint32_t)LoRa.random() << 16
+			| (uint32_t)LoRa.random() << 8 | LoRa.random()) | 1;
+
 	return 0;
 }
 
+/*
+ * setupRfTest: setup modem RF test parameters, the modem stays in AT mode
+ *
+ * Arguments: - pointer to test configuration to use
+ *
+ * Return:	  - return 0 if OK, -1 if error
+ */
+static int
+setupRfTest(const sLoRaConfiguration_t * newConf){
+
+	rfRun = false;
+	if (!modem.begin(freqPlan)) {
+		debugSerial.println("Failed to start module");
+		return -1;
+	}
+
+	if (newConf->bandWidth != 125 && newConf->bandWidth != 250){
+		debugSerial.println("Invalid RF test bandwidth [ 250 | 125 ]");
+		return -1;
+	}
+
+	return !modem.testConfig((uint32_t)newConf->frequency * 100000,
+			txPwrDbm(newConf->txPowerTst), newConf->bandWidth, newConf->spreadFactor,
+			newConf->codeRate, true, newConf->txPowerTst == 0) * -1;
+}
+
 /*
  * setupPacket: setup LoRa packet parameters communication with modem
  *
@@ -420,16 +1455,183 @@ setupPacket(const sLoRaConfiguration_t * newConf){
  *
  * Return:	  status of sending, < 0 = error, 0 = busy, 1 = done, 2 = stop
  * 			--- ALWAYS RETURNS 0
+ *
+ * The first call starts the TX chain, every TX done interrupt starts the
+ * next packet until the results are read.
  */
 int
 LoRaMgmtSendDumb(){
-	if (internalState != iSleep){	// Does never wait!
+	if (!dumbRun){
+		dumbRun = true;
+		dumbFirstTS = getMicros();
+		LoRa.onTxDone(onDumbTxDone);
+		if (conf->confMsk & CM_LBT)
+			lbtListen(true);
+		else
+			(void)dumbStart();
+	}
+	else if (lbtPend)
+		lbtCheck();
+	else if (dumbPend)
+		(void)dumbStart();
+	return 0;
+}
+
+/*
+ * LoRaMgmtSniff: capture all frames with the mode 1 radio settings
+ *
+ * Arguments: -
+ *
+ * Return:	  status of sniffing, < 0 = error, 0 = busy, 1 = done, 2 = stop
+ * 			--- ALWAYS RETURNS 0
+ *
+ * The first call starts continuous RX, later calls output batches of
+ * captured records until the results are read.
+ */
+int
+LoRaMgmtSniff(){
+	if (!sniffRun){
+		sniffRun = true;
+		sniffHead = 0;
+		sniffTail = 0;
+		sniffDrop = 0;
+		sniffTS = millis();
+		perHash = FNVBASIS;
+		for (int i = PHDRLEN; i < payloadLen(); i++)
+			perHash = (perHash ^ genbuf[i]) * FNVPRIME;
+		LoRa.onReceive(onSniffRx);
+		// implicit header needs the expected length
+		LoRa.receive((conf->confMsk & CM_EXHDR) ? 0 : payloadLen());
+	}
+
+	if (conf->mode == 6){
+		perCount();
+		return 0;
+	}
+
+	uint8_t cnt = (uint8_t)(sniffHead - sniffTail);
+	if (cnt >= SNIFFBATCH || (cnt && millis() - sniffTS > SNIFFAGE))
+		(void)sniffFlush();
+	return 0;
+}
+
+/*
+ * LoRaMgmtScan: sample the RSSI of all scan channels for the dwell time each
+ *
+ * Arguments: -
+ *
+ * Return:	  status of scanning, < 0 = error, 0 = busy, 1 = done, 2 = stop
+ *
+ * Every call takes one RSSI sample, one test is one sweep over all channels.
+ */
+int
+LoRaMgmtScan(){
+	if (!scanRun){
+		scanRun = true;
+		scanIdx = 0;
+		scanChannel(scanIdx);
+		return 0;
+	}
+
+	uint32_t dwell = millis() - scanTS;
+	if (dwell < SCANSETTLE)
+		return 0;
+
+	if (dwell < (uint32_t)conf->scanDwell + SCANSETTLE){
+		int rssi = LoRa.rssi();
+		sLoRaScan_t * chn = &stats.scan[scanIdx];
+		chn->samples++;
+		chn->rssiSum += rssi;
+		if (rssi > chn->rssiMax)
+			chn->rssiMax = (int16_t)rssi;
+		if (rssi >= conf->busyLevel)
+			chn->busy++;
+		int bin = (rssi - LORASCANMIN) / LORASCANBINW;
+		chn->bins[(bin < 0) ? 0 : (bin >= LORASCANBINS) ? LORASCANBINS - 1 : bin]++;
+		histAdd(&stats.rxRssi, rssi);
 		trn->txCount++;
-		while (LoRa.beginPacket(conf->confMsk & CM_EXHDR) == 0) {
-		  delay(1);
+		return 0;
+	}
+
+	if (++scanIdx < LORASCANCHN){
+		scanChannel(scanIdx);
+		return 0;
+	}
+
+	LoRa.idle();
+	scanRun = false;
+	return 1;
+}
+
+/*
+ * LoRaMgmtRfTest: run a modem RF test through the AT interface
+ *
+ * Arguments: -
+ *
+ * Return:	  status of the test, < 0 = error, 0 = busy, 1 = done, 2 = stop
+ *
+ * The first call starts the test, later calls count the packets sent or
+ * received until the modem completes the command. The tone runs until stop.
+ */
+int
+LoRaMgmtRfTest(){
+	if (!rfRun){
+		rfRun = true;
+		switch (conf->rfTest){
+		default:
+		case RT_TX: modem.testTx(conf->rfCount);
+				break;
+		case RT_RX: modem.testRx(conf->rfCount);
+				break;
+		case RT_RSSI: modem.testRssi();
+				break;
+		case RT_TONE:
+				if (!modem.testTone()){
+					rfRun = false;
+					return -1;
+				}
+		}
+		return 0;
+	}
+
+	if (conf->rfTest == RT_TONE)
+		return 0;	// carrier on until stop
+
+	int rssi = 0, snr = 0;
+	_test_event evt;
+	while ((evt = modem.testEvent(&rssi, &snr)) != TEST_NONE){
+		switch (evt){
+		case TEST_TXDONE:
+		case TEST_RXDONE:
+			trn->txCount++;
+			break;
+		case TEST_RSSI:
+			trn->txCount++;
+			// fall-through
+			// @suppress("No break at end of case")
+		case TEST_RXINFO:
+			trn->rxRssi = (int8_t)rssi;
+			histAdd(&stats.rxRssi, rssi);
+			if (evt == TEST_RXINFO){
+				trn->rxSnr = (int8_t)snr;
+				histAdd(&stats.rxSnr, snr);
+			}
+			break;
+		case TEST_TIMEOUT:
+			stats.rfTimeout++;
+			break;
+		case TEST_RXERROR:
+			stats.rfRxError++;
+			break;
+		case TEST_END:
+			rfRun = false;
+			return 1;
+		case TEST_ERROR:
+			rfRun = false;
+			return -1;
+		default:
+			break;
 		}
-		LoRa.write(genbuf, conf->dataLen);
-		LoRa.endPacket(true); // true = async / non-blocking mode
 	}
 	return 0;
 }
@@ -444,14 +1646,36 @@ LoRaMgmtSendDumb(){
 int
 LoRaMgmtSend(){
 	if (internalState == iIdle){
+		// slotted mode, wait for the next slot of the node
+		uint32_t slot = slotWait();
+		if (slot){
+			stats.slotWait += slot;
+			waitMs = slot;
+			internalState = iWait;
+			return 0;
+		}
+		if (conf->slotLen)
+			stats.slotSends++;
+
 		internalState = iSend;
 
-		if (conf->repeatSend != 0){
+		// one identity per uplink, rotate if already used since the join
+		if (idCount && !(conf->confMsk & CM_OTAA)){
+			if (!idFresh && idJoin((uint8_t)((idCur + 1) % idCount))){
+				internalState = iIdle;
+				return -1;
+			}
+			idFresh = false;
+		}
+
+		if (!fcuSync){
 			fcu = modem.getFCU();
+			fcuSync = true;
 		}
+		writeHeader(genbuf);
 		onBeforeTx();
 		modem.beginPacket();
-		modem.write(genbuf, conf->dataLen);
+		modem.write(genbuf, payloadLen());
 		int ret = modem.endPacket(!(conf->confMsk & CM_UCNF));
 		onAfterTx();
 		if (ret < 0){
@@ -463,15 +1687,34 @@ LoRaMgmtSend(){
 				internalState = iChnWait;
 				return 0;
 			}
+			if (idActive())
+				idActive()->failed++;
 			return ret;
 		}
 
 		internalState = iBusy;
 		pollcnt = 0;
 		trn->txCount++;
-
-		if (conf->repeatSend == 0)
-			return 0; // If set to infinite, repeat send command until end
+		fcUplink(trn->timeTx / 1000);
+		arrivalSent();
+		if (!(conf->confMsk & CM_UCNF))	// DR of the uplink, selects the time-to-ACK estimator
+			trn->txDR = (conf->dataRate <= 5) ? conf->dataRate : (lastDR = modem.getDataRate());
+		if (idActive())
+			idActive()->txCount++;
+		trn->paySeed = paySeed;
+		hdrSeq++;
+		histAdd(&stats.timeTx, (int32_t)trn->timeTx);
+
+		if (conf->repeatSend == 0){
+			// If set to infinite, repeat send command until end, a new packet of the arrival process
+			uint32_t busyMs = conf->rxWindow1 - trn->timeTx / 1000;
+			arrivalNext(conf);
+			if (internalState == iWait && waitMs < busyMs)
+				internalState = iBusy;
+			trn->dataLen = payLen;
+			(void)generatePayload(genbuf, payLen, conf->payMode);
+			return 0;
+		}
 
 		if (POLL_NO == 0 && (conf->confMsk & CM_UCNF))
 			return 2;
@@ -492,20 +1735,63 @@ LoRaMgmtPoll(){
 	if (internalState == iIdle){
 		internalState = iPoll;
 
-		uint32_t nfcu = modem.getFCU();
-		if (nfcu == fcu || nfcu == 0){
-			// Not yet sent?
-			internalState = iRetry;
-			return 0;
-		}
+		// MAC done after the RX windows, wait without AT+FCU round trips
+		uint32_t elapsed = millis() - sendTS;
+		uint32_t macDone = conf->rxWindow2 + computeAirTime(payloadLen(), trn->txDR) + MACDONEMRG;
 
-		// Confirmed packages trigger a retry after a polling retry delay.
+		// Confirmed packages, check from the learned time-to-ACK until its timeout
 		if (!(conf->confMsk & CM_UCNF)){
+			sLoRaAckEst_t * est = ackEst();
+			// first check one deviation before the mean, RX1 opens not earlier
+			uint32_t first = conf->rxWindow1;
+			if (est->srtt && (est->srtt >> ACKGAIN) > first + (est->rttvar >> ACKVARGAIN))
+				first = (est->srtt >> ACKGAIN) - (est->rttvar >> ACKVARGAIN);
+			if (elapsed < first){
+				waitMs = first - elapsed;
+				internalState = iWait;
+				return 0;
+			}
+			// AT+CFS is the status of the previous uplink until the MAC sent this one
+			if (!fcuSent){
+				uint32_t nfcu = modem.getFCU();
+				if (nfcu == fcu - 1 || nfcu == 0){
+					// delayed in the modem, e.g. duty cycle, time the RX windows from now on
+					sendTS = millis();
+					internalState = iRetry;
+					return 0;
+				}
+				fcuSent = true;
+			}
+			if (!modem.getMsgConfirmed()){
+				// RX2 may still deliver, the MAC is busy until then
+				if (elapsed < macDone){
+					est->early++;
+					internalState = iRetry;
+					return 0;
+				}
+				onAfterRx();
+				internalState = iIdle;
+				if (idActive())
+					idActive()->failed++;
+				return -1;
+			}
+			if (elapsed > ackTimeout(est, macDone))
+				est->late++;	// e.g. RX2 after RX1 acknowledgments, the sample widens the estimate
+			ackSample(est, elapsed);
 			onAfterRx();
 			internalState = iIdle;
-			return modem.getMsgConfirmed() ? 2 : -1 ;
+			if (idActive())
+				idActive()->acked++;
+			fcDownlink();	// the acknowledgment is a downlink
+			recordRx();
+			return 2;
 		}
 		else{
+			if (elapsed < macDone){
+				internalState = iRetry;
+				return 0;
+			}
+			uint32_t pollTS = millis();
 			int ret = modem.poll();
 			if (ret <= 0){
 				if (pollcnt < POLL_NO-1){
@@ -523,11 +1809,14 @@ LoRaMgmtPoll(){
 
 			pollcnt++;
 			trn->txCount++;
+			fcUplink(millis() - pollTS);
 
 			// read receive buffer
 			if (modem.available()){
 				// message received
 				onAfterRx();
+				fcDownlink();
+				recordRx();
 				char rcv[MAXLORALEN];
 				int len = modem.readBytesUntil('\r', rcv, MAXLORALEN);
 				printMessage(rcv, len);
@@ -555,29 +1844,54 @@ LoRaMgmtPoll(){
 int
 LoRaMgmtRemote(){
 	if (internalState == iIdle){
-		internalState = iPoll;
-
-		int ret = modem.poll();
-		if (ret < 0 && ret != LORABUSY)
-			return ret;
+		if (conf->rmtListen){
+			// class C, down-links arrive at any time without poll uplinks
+			if (!classC){
+				if (!modem.configureClass(CLASS_C))
+					return -1;
+				classC = true;
+			}
+			waitMs = RMTLISTEN;
+			internalState = iWait;
+		}
+		else
+			internalState = iPoll;
 
+		// down-link of the last uplink, received while sleeping
+		uint32_t checkTS = millis();	// parsing a down-link ends with the read timeout
 		if (!modem.available()) {
-			// No down-link message received at this time.
+			if (classC)
+				return 0;
+			uint32_t pollTS = millis();
+			int ret = modem.poll();
+			if (ret < 0 && ret != LORABUSY)
+				return ret;
+			if (ret > 0)
+				fcUplink(millis() - pollTS);
 			return 0;
 		}
+		// class C down-links end before the check, class A ones relate to the last uplink
+		uint32_t anchorTS = (classC) ? checkTS : sendTS;
+		fcDownlink();
 
 		char rcv[MAXLORALEN];
-		int len = modem.readBytesUntil('\r', rcv, MAXLORALEN);
+		int len = modem.read((uint8_t *)rcv, min(modem.available(), MAXLORALEN));
 
 		if (len == 1){ // one letter
 			switch(rcv[0]){
 			case 'R':
-				return 1;
+				return remoteDone(1);
 
 			case 'S':
-				return 2;
+				return remoteDone(2);
 			}
 		}
+		else if (len == SYNCLEN && rcv[0] == 'T'){ // synchronized start
+			int ret = remoteDone(1);
+			if (ret > 0)
+				remoteSync((uint8_t *)rcv, anchorTS);
+			return ret;
+		}
 
 		debugSerial.print("Invalid message, ");
 		printMessage(rcv, len);
@@ -603,27 +1917,47 @@ LoRaMgmtSetup(const sLoRaConfiguration_t * newConf,
 	default:
 	case 0: ;
 			break;
-	case 1: ret = setupDumb(newConf);
+	case 1:
+	case 5:
+	case 6:
+	case 8: ret = setupDumb(newConf);
+			break;
+	case 7: ret = setupRfTest(newConf);
 			break;
 	case 2 ... 4:
+		{
+			// mask 0 uses the channels suggested by the last scan
+			uint16_t chnMsk = (newConf->chnMsk) ? newConf->chnMsk : scanMsk;
 			ret = setupLoRaWan(newConf);
-			ret |= setChannels(newConf->chnMsk, newConf->dataRate);
+			ret |= setChannels(chnMsk, newConf->dataRate);
 			ret |= setupPacket(newConf);
-			setActiveBands(newConf->chnMsk);
+			setActiveBands(chnMsk);
 			if (newConf->repeatSend == 0)
 				internalState = iRndWait;
+			if (!arrRnd)	// independent of the payload generator
+				arrRnd = micros() | 1;
+			arrivalNext(newConf);
+		}
 	}
 	ret |= setTxPwr(newConf->mode, newConf->txPowerTst);
 
-	// initialize random seed with dataLen as value
+	// initialize generator with the configured seed, or with dataLen as value
 	// keep consistency among tests, but differs with diff len
-	rnd_contex = newConf->dataLen;
+	rndState = (newConf->paySeed) ? newConf->paySeed : PAYSEEDDEF + newConf->dataLen;
+	payCount = 0;
+	if (!MD_LORAWAN(newConf->mode))
+		payLen = newConf->dataLen;
 	// Prepare PayLoad of x bytes
-	(void)generatePayload(genbuf);
+	(void)generatePayload(genbuf, payLen, newConf->payMode);
 
 	trn = result;
+	trn->dataLen = payLen;
+	trn->timeWait = 0;
 
 	pollcnt = 0;
+	retryCnt = 0;
+	if (!retryRnd)	// independent of the payload generator
+		retryRnd = micros() | 1;
 	trn->txCount = 0;
 
 	if (ret == 0)
@@ -644,9 +1978,50 @@ int
 LoRaMgmtGetResults(sLoRaResutls_t ** const res){
 	if (!trn)
 		return -1;
+#ifdef LORA_TRACE
+	traceSerial.traceFlush();
+#endif
 	int ret = 0;
 	trn->testTime = millis() - startTestTS;
-	if (conf->mode == 1){
+	if (MD_RADIO(conf->mode)){
+		if (rfRun){		// stop test, e.g. tone or stop during a test
+			(void)modem.testOff();
+			rfRun = false;
+		}
+		if (dumbRun){	// stop TX chain, the packet in the air completes
+			dumbRun = false;
+			dumbPend = false;
+			if (lbtPend){	// stop listening
+				lbtPend = false;
+				LoRa.idle();
+			}
+			// the TX done interrupt updates the statistics, wait for it before reading them
+			uint32_t waitTS = millis();
+			while (dumbTx && millis() - waitTS < DUMBTXMAX)
+				;
+			LoRa.onTxDone(NULL);
+			if (dumbTx){	// lost interrupt, abort the packet
+				LoRa.idle();
+				dumbTx = false;
+			}
+			stats.wallTime += getMicros() - dumbFirstTS;
+		}
+		if (sniffRun){	// stop receiver, output remaining records
+			LoRa.onReceive(NULL);
+			LoRa.idle();
+			sniffRun = false;
+			if (conf->mode == 6)
+				perCount();
+			else
+				while (sniffFlush())
+					;
+		}
+		if (scanRun){	// stop scan, keep the partial sweep
+			LoRa.idle();
+			scanRun = false;
+		}
+		if (conf->mode == 8)
+			trn->chnMsk = stats.scanMsk = scanMsk = scanMask();
 		trn->txFrq = conf->frequency*100000;
 		trn->lastCR = conf->codeRate;
 		trn->txDR = conf->spreadFactor;
@@ -658,15 +2033,142 @@ LoRaMgmtGetResults(sLoRaResutls_t ** const res){
 		ret |= getChannels(&trn->chnMsk);
 //		trn->lastCR = modem.getCR();	// Hard-coded in the Mac layer, always reads 4/5
 		trn->lastCR = 5;
-		trn->txDR = modem.getDataRate();
+		lastDR = trn->txDR = modem.getDataRate();
 		trn->txPwr = modem.getPower();
 		trn->rxRssi = modem.getRSSI();
 		trn->rxSnr = modem.getSNR();
+
+		// efficiency totals of the run
+		stats.run.tests++;
+		stats.run.delivered += trn->delivered;
+		stats.run.txCount += trn->txCount;
+		stats.run.rxCount += trn->rxCount;
+		stats.run.bytes += (trn->delivered) ? trn->dataLen : 0;
+		stats.run.runTime = millis() - runTS;
+		stats.run.timeAir += trn->timeAir;
 	}
 	*res = trn++;// shift to next slot
 	return (ret == 0) ? 1 : -1;
 }
 
+/*
+ * LoRaMgmtGetStats: getter for run statistics
+ *
+ * Arguments: - statistics structure pointer
+ *
+ * Return:	  - 0 if OK, -1 if no statistics are available
+ */
+int
+LoRaMgmtGetStats(const sLoRaStatistics_t ** const res){
+	if (!stats.timeTx.bins)
+		return -1;
+	*res = &stats;
+	return 0;
+}
+
+/*
+ * LoRaMgmtClearStats: reset run statistics and header sequence, to call at run start
+ *
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+void
+LoRaMgmtClearStats(){
+	histInit(&stats.timeTx, histTxBins, HIST_BINS(HISTTSUB, HISTTEXP), HISTTSUB, 0);
+	histInit(&stats.timeToRx, histToRxBins, HIST_BINS(HISTTSUB, HISTTEXP), HISTTSUB, 0);
+	histInit(&stats.timeRx, histRxBins, HIST_BINS(HISTTSUB, HISTTEXP), HISTTSUB, 0);
+	histInit(&stats.rxRssi, histRssiBins, HIST_BINS(HISTSSUB, HISTSEXP), HISTSSUB, HISTRSSIOFS);
+	histInit(&stats.rxSnr, histSnrBins, HIST_BINS(HISTSSUB, HISTSEXP), HISTSSUB, HISTSNROFS);
+	histInit(&stats.txGap, histGapBins, HIST_BINS(HISTTSUB, HISTTEXP), HISTTSUB, 0);
+	histInit(&stats.arrGap, histArrBins, HIST_BINS(HISTTSUB, HISTAEXP), HISTTSUB, 0);
+	histInit(&stats.arrLag, histLagBins, HIST_BINS(HISTTSUB, HISTAEXP), HISTTSUB, 0);
+	arrRun = false;
+	arrLastTS = 0;
+	slotTS = millis();	// slot frames start with the run unless synchronized
+	stats.synced = 0;
+	stats.syncDelay = 0;
+	stats.slotSends = 0;
+	stats.slotWait = 0;
+	stats.airTime = 0;
+	stats.wallTime = 0;
+	memset(stats.hopTx, 0, sizeof(stats.hopTx));
+	stats.perCount = 0;
+	stats.perNoHdr = 0;
+	stats.rfTimeout = 0;
+	stats.rfRxError = 0;
+	memset(stats.scan, 0, sizeof(stats.scan));
+	for (uint8_t i = 0; i < LORASCANCHN; i++){
+		stats.scan[i].frequency = scanFreq[i];
+		stats.scan[i].rssiMax = INT16_MIN;
+	}
+	stats.scanMsk = 0;
+	stats.fcu = fcu;
+	stats.fcd = fcd;
+	stats.fcdRx = 0;
+	stats.fcdLost = 0;
+	memset(&stats.run, 0, sizeof(stats.run));
+	runTS = millis();
+	for (uint8_t i = 0; i < LORAACKDR; i++){	// keep the estimates, new counters
+		stats.ackEst[i].samples = 0;
+		stats.ackEst[i].early = 0;
+		stats.ackEst[i].late = 0;
+	}
+	for (uint8_t i = 0; i < idCount; i++){
+		ids[i].txCount = 0;
+		ids[i].acked = 0;
+		ids[i].failed = 0;
+	}
+	hdrSeq = 0;
+}
+
+/*
+ * LoRaMgmtIdClear: empty the ABP identity table
+ *
+ * Arguments: -
+ *
+ * Return:	  -
+ */
+void
+LoRaMgmtIdClear(){
+	idCount = 0;
+	idCur = -1;
+}
+
+/*
+ * LoRaMgmtIdAdd: append an identity to the ABP identity table
+ *
+ * Arguments: - LORAIDLEN bytes, u8[4] device address, u8[16] network and application
+ * 				session key, u32 frame counter little endian
+ *
+ * Return:	  - 0 if OK, -1 if the table is full
+ */
+int
+LoRaMgmtIdAdd(const uint8_t * entry){
+	if (idCount >= LORAIDMAX)
+		return -1;
+	sLoRaIdentity_t * id = &ids[idCount++];
+	memset(id, 0, sizeof(sLoRaIdentity_t));
+	memcpy(id->devAddr, &entry[0], sizeof(id->devAddr));
+	memcpy(id->nwkSKey, &entry[4], sizeof(id->nwkSKey));
+	memcpy(id->appSKey, &entry[20], sizeof(id->appSKey));
+	memcpy(&id->fcu, &entry[36], sizeof(id->fcu));
+	return 0;
+}
+
+/*
+ * LoRaMgmtGetIds: getter for the ABP identity table
+ *
+ * Arguments: - identity table pointer
+ *
+ * Return:	  - number of identities
+ */
+int
+LoRaMgmtGetIds(const sLoRaIdentity_t ** const res){
+	*res = ids;
+	return idCount;
+}
+
 /*
  * LoRaMgmtJoin: Join a LoRaWan network
  *
@@ -682,26 +2184,63 @@ LoRaMgmtJoin(){
 }
 
 /*
- * LoRaMgmtUpdt: Update LoRa message buffer
+ * LoRaMgmtUpdt: Update LoRa message buffer, back-off before a retry
  *
- * Arguments: -
+ * Arguments: - the last attempt failed, i.e. restart is a retry
  *
- * Return:	  - return 0 if OK, -1 if error
+ * Return:	  - return 1 if updated, 0 if busy
  */
 int
-LoRaMgmtUpdt(){
+LoRaMgmtUpdt(int failed){
 	if (internalState == iIdle){
-		// Prepare PayLoad of x bytes
-		(void)generatePayload(genbuf);
+		// Prepare PayLoad of x bytes, a retry resends the packet of the test
+		if (!failed)
+			(void)generatePayload(genbuf, payLen, conf->payMode);
 
 		pollcnt = 0;
 
+		if (failed && conf->retryPolicy < RP_COUNT){
+			sLoRaRetry_t * rs = &stats.retry[conf->retryPolicy];
+			rs->retries++;
+			retryCnt++;
+			// the next send waits for the sleep to end
+			if ((waitMs = retryBackoff())){
+				rs->waitTime += waitMs;
+				internalState = iWait;
+			}
+		}
 		return 1;
 	}
 
 	return 0;
 }
 
+/*
+ * LoRaMgmtTestDone: account the end of a test for the delivery and retry statistics
+ *
+ * Arguments: - the test failed after all retries
+ *
+ * Return:	  -
+ */
+void
+LoRaMgmtTestDone(int failed){
+	if (!conf)
+		return;
+	trn->delivered = !failed;
+	if (conf->retryPolicy >= RP_COUNT)
+		return;
+	sLoRaRetry_t * rs = &stats.retry[conf->retryPolicy];
+	rs->tests++;
+	if (failed)
+		rs->givenUp++;
+	else{
+		rs->delivered++;
+		if (retryCnt)
+			rs->recovered++;
+	}
+	retryCnt = 0;
+}
+
 /*
  * LoRaMgmtRcnf: reset modem and reconfiguration
  *
@@ -736,7 +2275,27 @@ LoRaMgmtGetEUI(){
 		debugSerial.println("Failed to start module");
 		return NULL;
 	};
-	return modem.deviceEUI().c_str();
+	static String eui;	// keep buffer after return
+	eui = modem.deviceEUI();
+	return eui.c_str();
+}
+
+/*
+ * LoRaMgmtPrintMetrics: print AT transport metrics of the modem
+ *
+ * Arguments: - print target, CSV output
+ *
+ * Return:	  - return 0 if OK, -1 if metrics are compiled out
+ */
+int
+LoRaMgmtPrintMetrics(Print & out){
+#ifdef LORA_METRICS
+	modem.printMetrics(out);
+	return 0;
+#else
+	(void)out;
+	return -1;
+#endif
 }
 
 /*************** MAIN CALL FUNCTIONS ********************/
@@ -750,6 +2309,8 @@ LoRaMgmtGetEUI(){
  */
 void
 LoRaMgmtMain (){
+	(void)getMicros();	// keep track of micros() wraps
+
 	switch (internalState){
 
 	case iIdle:
@@ -762,33 +2323,47 @@ LoRaMgmtMain (){
 		break;
 	case iPoll:
 		startSleepTS = millis();
-		trn->txDR = modem.getDataRate();
-		sleepMillis = conf->rxWindow2 + computeAirTime(conf->dataLen, trn->txDR) + 1000; // e.g. ACK lost, = 2+-1s (random)
+		lastDR = trn->txDR = modem.getDataRate();
+		sleepMillis = conf->rxWindow2 + computeAirTime(payloadLen(), trn->txDR) + 1000; // e.g. ACK lost, = 2+-1s (random)
 		internalState = iSleep;
 		break;
 	case iBusy:	// Duty cycle = 1% chn [1-3], 0.1% chn [4-8]  pause = T/dc - T
 		startSleepTS = millis();
-		sleepMillis = conf->rxWindow1 - trn->timeTx;	// Wait for ~1 sec slot, default, configurable over RX1 delay
+		sleepMillis = conf->rxWindow1 - trn->timeTx / 1000;	// Wait for ~1 sec slot, default, configurable over RX1 delay
 														// TODO: for now used only as delay, not setting the actual value
 		internalState = iSleep;
 		break;
 	case iChnWait:
 		startSleepTS = millis();
-		trn->txDR = modem.getDataRate();
+		lastDR = trn->txDR = modem.getDataRate();
 		{
-			uint32_t timeAir = computeAirTime(conf->dataLen, trn->txDR);
+			uint32_t timeAir = computeAirTime(payloadLen(), trn->txDR);
 			sleepMillis =  timeAir * 100 - timeAir; // This is for Channel 1-3, others * 1000
 		}
 		internalState = iSleep;
 		break;
+	case iWait:
+		startSleepTS = millis();
+		sleepMillis = waitMs;
+		internalState = iSleep;
+		break;
 	case iRndWait:
 		startSleepTS = millis();
-		rnd_contex = startSleepTS % UINT16_MAX;
-		sleepMillis = rand_r(&rnd_contex) % conf->rxWindow1;
+		{
+			uint32_t rnd = startSleepTS | 1;	// independent of the payload generator
+			sleepMillis = xorshift32(&rnd) % conf->rxWindow1;
+		}
 		internalState = iSleep;
 		break;
 	case iSleep:
-		if (millis() - startSleepTS > sleepMillis)
+		if (millis() - startSleepTS > sleepMillis){
 			internalState = iIdle;
+			// count only the part within the test, sleeps may overlap the test restart
+			if (trn)
+				trn->timeWait += millis() - (((int32_t)(startTestTS - startSleepTS) > 0)
+						? startTestTS : startSleepTS);
+			stats.run.timeWait += millis() - (((int32_t)(runTS - startSleepTS) > 0)
+					? runTS : startSleepTS);
+		}
 	}
 }
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include "main.h"
+#include "Histogram.h"
 
 // Select frequency plan between TTN_FP_EU868 or TTN_FP_US915
 #define CM_OTAA			1		// LORAWAN use OTAA join instead of ABP
@@ -23,13 +24,70 @@
 
 #define CM_NPBLK		16		// LORAWAN & LORA use Private network
 #define CM_RSTMDM		32		// LORAWAN $ LORA reset modem after each test
+#define CM_PHDR			64		// LORAWAN & LORA test header in front of the payload
+#define CM_LBT			128		// LORA listen before talk in mode 1
+
+// Payload generator modes
+#define PM_RANDOM		0		// xorshift32 pseudo-random bytes
+#define PM_COUNTER		1		// 32 bit message counter, repeated, little endian
+#define PM_PATTERN		2		// fixed pattern of incrementing bytes 0x00, 0x01, ..
+#define PM_SENSOR		3		// Cayenne LPP sensor frames with pseudo-random values
+#define MAXLORALEN		242		// maximum payload length 0-51 for DR0-2, 115 for DR3, 242 otherwise
+
+#define LORAHOPMAX		8		// max entries of the mode 1 hop table
+
+// Modem RF tests of mode 7
+#define RT_TX			0		// send packets, AT+TTLRA
+#define RT_RX			1		// receive packets, AT+TRLRA
+#define RT_RSSI			2		// measure RSSI, AT+TRSSI
+#define RT_TONE			3		// continuous carrier until stop, AT+TTONE
+
+// LoRaWan retry back-off policies for failed tests
+#define RP_NONE			0		// retry right away
+#define RP_FIXED		1		// fixed back-off of retryDelay
+#define RP_EXP			2		// exponential back-off from retryDelay, doubling per retry, random jitter
+#define RP_DUTY			3		// duty cycle off-time of the failed uplink, at least retryDelay
+#define RP_COUNT		4		// number of policies
+
+// LoRaWan packet arrival processes, a new packet per test
+#define AP_NONE			0		// back-to-back, next test as soon as the previous ended
+#define AP_PERIODIC		1		// fixed period, uniform jitter
+#define AP_POISSON		2		// exponential inter-arrival times
+#define AP_BURST		3		// bursts of back-to-back packets, Poisson burst arrivals
+#define AP_COUNT		4		// number of processes
+
+// LoRaWan payload length distributions
+#define LD_FIXED		0		// data length
+#define LD_UNIFORM		1		// uniform between min length and data length
+#define LD_BIMODAL		2		// min length or data length, equally likely
+#define LD_COUNT		3		// number of distributions
+
+#define LORASCANCHN		8		// channels of the mode 8 scanner, EU868 default plan, chnMsk bits
+#define LORASCANBINS	8		// RSSI bins per scanned channel
+#define LORASCANMIN		-130	// lower edge of the first RSSI bin, in dBm
+#define LORASCANBINW	10		// RSSI bin width, in dB
+
+// Test mode groups
+#define MD_LORA(m)		((m) == 1 || (m) == 5 || (m) == 6 || (m) == 8)	// modes driving the LoRa radio directly
+#define MD_LORAWAN(m)	((m) >= 2 && (m) <= 4)	// modes using the LoRaWan modem stack
+#define MD_RADIO(m)		(MD_LORA(m) || (m) == 7)	// modes using the mode 1 radio settings
+
+/**
+  * LoRa hop table entry, radio settings for one packet
+  */
+typedef struct {
+	uint16_t frequency;		// LoRa frequency in 100KHz steps
+	uint8_t spreadFactor;	// spread factor
+	uint8_t bandWidth;		// bandwidth in kHz
+	uint8_t codeRate;		// code rate in 4/
+} sLoRaHop_t;
 
 /**
   * LoRa(Wan) Configuration
   */
 typedef struct
 {
-	uint8_t	mode  = 0;			// test mode = 0 off, 1 LoRa, 2 LoRaWan, 3 LoRaWan + Remote, 4 LoRaWan Force Join
+	uint8_t	mode  = 0;			// test mode = 0 off, 1 LoRa, 2 LoRaWan, 3 LoRaWan + Remote, 4 LoRaWan Force Join, 5 LoRa sniffer, 6 LoRa PER receiver, 7 modem RF test, 8 channel scanner
 	uint8_t confMsk;			// Configuration mask bits
 
 	// Common all Modes
@@ -38,6 +96,30 @@ typedef struct
 	uint8_t repeatSend = 5;		// number of send repeats
 	uint16_t rxWindow1 = 1000;  // pause duration in ms between tx and rx, default 1 sec
 	uint16_t rxWindow2 = 2000;  // pause duration in ms between tx and rx2 default 2 sec
+	uint8_t payMode = PM_RANDOM;// payload generator mode
+	uint32_t paySeed = 0;		// payload generator seed, 0 = derive from data length
+	uint16_t testId = 0;		// test identifier in the payload header
+	uint8_t rfTest = RT_TX;		// mode 7 modem RF test, RT_*
+	uint16_t rfCount = 10;		// mode 7 packets per test
+	uint16_t scanDwell = 100;	// mode 8 dwell time per channel, in ms
+	int8_t busyLevel = -100;	// mode 1 LBT and mode 8 RSSI level of a busy channel, in dBm
+	uint16_t lbtBackoff = 50;	// mode 1 LBT max random back-off on a busy channel, in ms
+	uint8_t retryPolicy = RP_NONE;	// LoRaWan back-off before retrying a failed test, RP_*
+	uint16_t retryDelay = 1000;	// LoRaWan retry back-off base, in ms
+	uint8_t arrival = AP_NONE;	// LoRaWan packet arrival process, AP_*
+	uint16_t arrPeriod = 600;	// LoRaWan mean inter-arrival time (of bursts), in 100 ms
+	uint8_t arrJitter = 0;		// LoRaWan AP_PERIODIC jitter, +- percent of the period
+	uint8_t burstLen = 5;		// LoRaWan AP_BURST packets per burst
+	uint8_t lenDist = LD_FIXED;	// LoRaWan payload length distribution, LD_*
+	uint8_t lenMin = 1;			// LoRaWan shortest payload of LD_UNIFORM and LD_BIMODAL
+	uint16_t slotLen = 0;		// LoRaWan slot length in ms, 0 = pure ALOHA
+	uint8_t slotIdx = 0;		// LoRaWan slot of the node in the frame
+	uint8_t slotCount = 1;		// LoRaWan slots per frame
+	uint8_t rmtListen = 0;		// mode 3 listen in class C for remote commands instead of polling
+
+	// LoRa hop table, cycled per packet if not empty
+	uint8_t hopCount = 0;		// entries used in hop table
+	sLoRaHop_t hops[LORAHOPMAX];
 	union { // 16Bit
 		uint16_t frequency;		// LoRa / FSK frequency in 100KHz steps
 		uint16_t chnMsk;		// ChannelMask for LoRaWan EU868 (1-16)
@@ -77,9 +159,12 @@ typedef struct
 typedef struct {
 	uint32_t txCount;		// transmission counter
 	uint32_t testTime;		// total test time for this run
-	uint32_t timeTx;		// time for TX
-	uint32_t timeRx;		// time for RX
-	uint32_t timeToRx;		// total time until response
+	uint32_t timeTx;		// time for TX, in us
+	uint32_t timeRx;		// time for RX, in us
+	uint32_t timeToRx;		// total time until response, in us
+	uint32_t timeHost;		// TX host overhead, before and after the command, in us
+	uint32_t timeUart;		// TX UART transfer of command and payload, in us
+	uint32_t timeModem;		// TX modem processing and air time until reply, in us
 	uint32_t txFrq;			// current used frequency
 	uint16_t chnMsk;		// Concluding channel mask
 	uint8_t  lastCR;		// Coding rate 4/x
@@ -87,8 +172,132 @@ typedef struct {
 	int8_t   txPwr;			// Tx power index used
 	int8_t   rxRssi;		// last rx RSSI, default -128
 	int8_t   rxSnr;			// last rx SNR, default -128
+	uint32_t paySeed;		// generator state (counter for PM_COUNTER) before the last payload
+	uint32_t rxCount;		// acknowledgments and downlinks received
+	uint32_t timeAir;		// air time of the uplinks, in ms
+	uint32_t timeWait;		// time in waits, RX windows, duty cycle and back-off, in ms
+	uint8_t  delivered;		// test successful, for unconfirmed uplinks sent
+	uint8_t  dataLen;		// payload length of the test
 } sLoRaResutls_t;
 
+/**
+  * LoRaWan efficiency totals of a run
+  */
+typedef struct {
+	uint32_t tests;			// tests evaluated
+	uint32_t delivered;		// tests successful
+	uint32_t txCount;		// uplinks sent, including retries and polls
+	uint32_t rxCount;		// acknowledgments and downlinks received
+	uint32_t bytes;			// payload bytes of the successful tests
+	uint64_t runTime;		// wall time from the run start to the last evaluation, in ms
+	uint64_t timeAir;		// sum of uplink air times, in ms
+	uint64_t timeWait;		// sum of wait times since the run start, also between tests, in ms
+} sLoRaGoodput_t;
+
+#define LORAPERMAX		8		// max test IDs tracked by the PER receiver
+#define LORAIDMAX		32		// max ABP identities emulated by one node
+#define LORAIDLEN		40		// bytes per identity upload, address, keys, frame counter
+#define LORAACKDR		8		// time-to-ACK estimators, one per LoRaWan data rate
+
+/**
+  * LoRaWan ABP identity, an emulated device rotated per uplink
+  */
+typedef struct {
+	uint8_t devAddr[4];		// device address, big endian as printed
+	uint8_t nwkSKey[16];	// network session key
+	uint8_t appSKey[16];	// application session key
+	uint32_t fcu;			// uplink frame counter, restored when switching to the identity
+	uint32_t txCount;		// uplinks sent in the run
+	uint32_t acked;			// confirmed uplinks acknowledged in the run
+	uint32_t failed;		// uplinks or acknowledgments failed in the run
+} sLoRaIdentity_t;
+
+/**
+  * LoRaWan time-to-ACK estimator of a data rate, smoothed like the TCP RTT (RFC 6298)
+  */
+typedef struct {
+	uint32_t srtt;			// smoothed time from TX done to ACK, in ms * 8, 0 = no estimate
+	uint32_t rttvar;		// smoothed mean deviation, in ms * 4
+	uint32_t samples;		// acknowledgments measured in the run
+	uint32_t early;			// ACK checks in the run without acknowledgment
+	uint32_t late;			// acknowledgments after the timeout in the run
+} sLoRaAckEst_t;
+
+/**
+  * LoRaWan retry counters of a back-off policy
+  */
+typedef struct {
+	uint32_t tests;			// tests ended with the policy
+	uint32_t delivered;		// tests ended successful
+	uint32_t recovered;		// successful tests that needed at least one retry
+	uint32_t givenUp;		// tests failed after all retries
+	uint32_t retries;		// restarts after a failed attempt
+	uint64_t waitTime;		// time spent in retry back-off, in ms
+} sLoRaRetry_t;
+
+/**
+  * LoRa PER receiver counters of one test ID
+  */
+typedef struct {
+	uint16_t testId;		// test ID of the transmitter header
+	uint32_t lastSeq;		// highest sequence number received, the sequence starts at 0
+	uint32_t received;		// frames received, including duplicated and corrupted
+	uint32_t duplicates;	// frames received more than once
+	uint32_t corrupted;		// frames with wrong length or payload hash
+	int32_t rssiSum;		// sum of RSSI, for mean
+	int32_t snrSum;			// sum of SNR, for mean
+} sLoRaPer_t;
+
+/**
+  * LoRa channel scanner counters of one channel
+  */
+typedef struct {
+	uint16_t frequency;		// channel frequency in 100KHz steps
+	int16_t rssiMax;		// highest RSSI sampled
+	uint32_t samples;		// RSSI samples taken
+	uint32_t busy;			// samples at or above the busy level
+	int64_t rssiSum;		// sum of RSSI, for mean
+	uint32_t bins[LORASCANBINS];	// RSSI distribution, LORASCANBINW dB from LORASCANMIN
+} sLoRaScan_t;
+
+/**
+  * LoRa(Wan) run statistics, distributions over all tests of a run
+  */
+typedef struct {
+	sHistogram_t timeTx;	// time for TX, in us
+	sHistogram_t timeToRx;	// total time until response, in us
+	sHistogram_t timeRx;	// time for RX, in us
+	sHistogram_t rxRssi;	// RX RSSI of acknowledged/received messages
+	sHistogram_t rxSnr;		// RX SNR of acknowledged/received messages
+	sHistogram_t txGap;		// mode 1 gap between TX done and next TX start, in us
+	sHistogram_t arrGap;	// LoRaWan realised inter-arrival time of new packets, in ms
+	sHistogram_t arrLag;	// LoRaWan send start after the scheduled arrival, in ms
+	uint64_t airTime;		// mode 1 accumulated air time, in us
+	uint64_t wallTime;		// mode 1 time from first TX start to stop, in us
+	uint32_t hopTx[LORAHOPMAX];	// mode 1 transmissions per hop table entry
+	uint32_t lbtFrames;		// mode 1 frames deferred by LBT at least once
+	uint32_t lbtDefer;		// mode 1 LBT back-offs on a busy channel
+	uint64_t lbtBusyTime;	// mode 1 time from first busy detection to clear channel, in us
+	uint32_t fcu;			// LoRaWan uplink frame counter of the next uplink, tracked locally
+	uint32_t fcd;			// LoRaWan downlink frame counter of the last downlink
+	uint32_t fcdRx;			// LoRaWan downlinks received
+	uint32_t fcdLost;		// LoRaWan downlinks missed, gaps in the downlink frame counter
+	sLoRaAckEst_t ackEst[LORAACKDR];	// LoRaWan time-to-ACK per DR, estimates kept across runs
+	sLoRaRetry_t retry[RP_COUNT];	// LoRaWan retries per back-off policy, kept across runs
+	sLoRaGoodput_t run;		// LoRaWan efficiency totals of the run
+	uint8_t synced;			// mode 3 start synchronized by a T downlink
+	int32_t syncDelay;		// mode 3 time from reading the T downlink to the start, in ms, < 0 late
+	uint32_t slotSends;		// LoRaWan uplinks started in the slot of the node
+	uint64_t slotWait;		// LoRaWan time waited for the slot, in ms
+	sLoRaPer_t per[LORAPERMAX];	// mode 6 counters per test ID, or TX restart
+	uint8_t perCount;		// mode 6 entries used
+	uint32_t perNoHdr;		// mode 6 frames without test header
+	uint32_t rfTimeout;		// mode 7 TX or RX timeouts
+	uint32_t rfRxError;		// mode 7 RX errors, e.g. CRC
+	sLoRaScan_t scan[LORASCANCHN];	// mode 8 counters per channel
+	uint16_t scanMsk;		// mode 8 suggested channel mask, channels below SCANFREE busy
+} sLoRaStatistics_t;
+
 void LoRaMgmtMain();
 
 int LoRaMgmtSetup(const sLoRaConfiguration_t * conf, sLoRaResutls_t * const result);
@@ -96,13 +305,23 @@ int LoRaMgmtJoin();
 
 int LoRaMgmtSend();
 int LoRaMgmtSendDumb();
+int LoRaMgmtSniff();
+int LoRaMgmtRfTest();
+int LoRaMgmtScan();
 int LoRaMgmtPoll();
 int LoRaMgmtRemote();
 
 int LoRaMgmtGetResults(sLoRaResutls_t ** const res);
+int LoRaMgmtGetStats(const sLoRaStatistics_t ** const stats);
+void LoRaMgmtIdClear();
+int LoRaMgmtIdAdd(const uint8_t * entry);
+int LoRaMgmtGetIds(const sLoRaIdentity_t ** const ids);
+void LoRaMgmtClearStats();
 
 const char* LoRaMgmtGetEUI();
-int LoRaMgmtUpdt();
+int LoRaMgmtPrintMetrics(Print & out);
+int LoRaMgmtUpdt(int failed);
+void LoRaMgmtTestDone(int failed);
 int LoRaMgmtRcnf();
 
 #endif /* LORAMGMT_H_ */
@@ -0,0 +1,251 @@
+/*
+ * LoRaTrace.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ *
+ *  Record and replay of the serial traffic between LoRaModem and the Murata module.
+ *
+ *  Trace format, a file header followed by records:
+ *  	header		"LRT1"
+ *  	record		1 byte, bit 7 direction (1 = modem to host), bits 0-6 data length - 1
+ *  				time in us since the last byte of the previous record, LEB128 varint
+ *  				data bytes
+ *  Consecutive bytes in the same direction and less than TRACE_GAP apart share a record.
+ */
+
+#ifndef LORATRACE_H_
+#define LORATRACE_H_
+
+#include "Arduino.h"
+
+#define TRACE_MAGIC		"LRT1"
+#define TRACE_RX		0x80	// record direction bit, modem to host
+#define TRACE_MAXREC	128		// max data bytes per record
+#define TRACE_GAP		2000	// max gap in us to merge bytes into a record
+
+/*
+ * LoRaTraceStream: pass-through stream recording all traffic to a sink
+ */
+class LoRaTraceStream : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+  LoRaTraceStream(Stream & stream, Print & sink)
+    : stream(stream), sink(sink)
+  {
+    started = false;
+    recDir = 0;
+    recLen = 0;
+    recDelta = 0;
+    lastTS = 0;
+  }
+
+  virtual int available() {
+    return stream.available();
+  }
+
+  virtual int read() {
+    int c = stream.read();
+    if (c >= 0)
+      record(TRACE_RX, (uint8_t)c);
+    return c;
+  }
+
+  virtual int peek() {
+    return stream.peek();
+  }
+
+  virtual size_t write(uint8_t c) {
+    record(0, c);
+    return stream.write(c);
+  }
+
+  using Print::write;
+
+  virtual void flush() {
+    stream.flush();
+  }
+
+  /*
+   * traceFlush: write pending record to the sink, e.g. at the end of a test
+   */
+  void traceFlush() {
+    if (!recLen)
+      return;
+
+    uint8_t hdr = recDir | (uint8_t)(recLen - 1);
+    sink.write(hdr);
+    uint32_t delta = recDelta;
+    do { // LEB128 varint
+      uint8_t b = delta & 0x7F;
+      delta >>= 7;
+      sink.write((uint8_t)(b | (delta ? 0x80 : 0)));
+    } while (delta);
+    sink.write(recBuf, recLen);
+    recLen = 0;
+  }
+
+private:
+  Stream &	stream;
+  Print &	sink;
+  bool		started;
+  uint8_t	recDir;				// direction of pending record
+  uint8_t	recLen;				// bytes in pending record
+  uint32_t	recDelta;			// time from previous record to pending record
+  uint32_t	lastTS;				// time stamp of last byte traced
+  uint8_t	recBuf[TRACE_MAXREC];
+
+  void record(uint8_t dir, uint8_t c) {
+    uint32_t now = micros();
+    if (!started) {
+      sink.write((const uint8_t *)TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1);
+      started = true;
+      lastTS = now;
+    }
+    if (recLen && (dir != recDir || recLen >= TRACE_MAXREC || now - lastTS > TRACE_GAP))
+      traceFlush();
+    if (!recLen) {
+      recDir = dir;
+      recDelta = now - lastTS;
+    }
+    recBuf[recLen++] = c;
+    lastTS = now;
+  }
+};
+
+/*
+ * LoRaReplayStream: emulates the modem by playing back a trace
+ *
+ * Host writes are matched against the recorded host-to-modem bytes, modem
+ * responses are released only after the preceding host writes happened and
+ * their recorded delay elapsed. In fast mode, the skip callback advances the
+ * clock to the next response instead of waiting for it.
+ */
+class LoRaReplayStream : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+  LoRaReplayStream(Stream & trace, void (*skip)(uint32_t us) = NULL)
+    : trace(trace), skip(skip)
+  {
+    recDir = 0;
+    recLen = 0;
+    recPos = 0;
+    recDelta = 0;
+    anchorTS = 0;
+    eof = true;
+    mismatch = 0;
+    txBytes = 0;
+    rxBytes = 0;
+    overrun = 0;
+  }
+
+  /*
+   * begin: check trace header and load first record
+   *
+   * Returns: true if the trace is valid
+   */
+  bool begin() {
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    if (trace.readBytes(magic, sizeof(magic)) != sizeof(magic)
+        || memcmp(magic, TRACE_MAGIC, sizeof(magic)))
+      return false;
+    anchorTS = micros();
+    eof = !loadRecord();
+    return true;
+  }
+
+  virtual int available() {
+    if (eof || recDir != TRACE_RX)
+      return 0;	// waiting for host
+    uint32_t wait = anchorTS + recDelta - micros();
+    if ((int32_t)wait > 0) {
+      if (!skip)
+        return 0;
+      skip(wait);	// fast mode, no need to wait
+    }
+    return recLen - recPos;
+  }
+
+  virtual int read() {
+    if (!available())
+      return -1;
+    rxBytes++;
+    uint8_t c = recBuf[recPos++];
+    if (recPos >= recLen)
+      nextRecord(anchorTS + recDelta);	// keep modem side timing
+    return c;
+  }
+
+  virtual int peek() {
+    if (!available())
+      return -1;
+    return recBuf[recPos];
+  }
+
+  virtual size_t write(uint8_t c) {
+    txBytes++;
+    if (eof) {
+      overrun++;	// host continues after the trace
+      return 1;
+    }
+    if (recDir == TRACE_RX) {
+      mismatch++;	// unexpected host write
+      return 1;
+    }
+    if (recBuf[recPos++] != c)
+      mismatch++;
+    if (recPos >= recLen)
+      nextRecord(micros());
+    return 1;
+  }
+
+  using Print::write;
+
+  virtual void flush() {}
+
+  bool done() { return eof; }
+  uint32_t getMismatch() { return mismatch; }
+  uint32_t getOverrun() { return overrun; }
+  uint32_t getTxBytes() { return txBytes; }
+  uint32_t getRxBytes() { return rxBytes; }
+
+private:
+  Stream &	trace;
+  void		(*skip)(uint32_t us);
+  uint8_t	recDir;				// direction of current record
+  uint8_t	recLen;				// data bytes in current record
+  uint8_t	recPos;				// data bytes consumed of current record
+  uint32_t	recDelta;			// recorded delay to previous record
+  uint32_t	anchorTS;			// time stamp of previous record completion
+  bool		eof;				// trace fully replayed
+  uint32_t	mismatch;			// host writes differing from the trace
+  uint32_t	txBytes;			// bytes written by the host
+  uint32_t	rxBytes;			// bytes read by the host
+  uint32_t	overrun;			// bytes written by the host after the trace ended
+  uint8_t	recBuf[TRACE_MAXREC];
+
+  void nextRecord(uint32_t ts) {
+    anchorTS = ts;
+    eof = !loadRecord();
+  }
+
+  bool loadRecord() {
+    uint8_t hdr;
+    if (trace.readBytes((char *)&hdr, 1) != 1)
+      return false;
+    recDir = hdr & TRACE_RX;
+    recLen = (hdr & ~TRACE_RX) + 1;
+    recPos = 0;
+    recDelta = 0;
+    uint8_t b, shift = 0;
+    do { // LEB128 varint
+      if (trace.readBytes((char *)&b, 1) != 1)
+        return false;
+      recDelta |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    return trace.readBytes((char *)recBuf, recLen) == recLen;
+  }
+};
+
+#endif /* LORATRACE_H_ */
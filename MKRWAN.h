@@ -179,6 +179,13 @@ typedef const char* ConstStr;
 #define GFP(x) x
 #define GF(x)  x
 
+#ifdef LORA_METRICS
+  #include "Histogram.h"
+  #define METRIC(...) __VA_ARGS__
+#else
+  #define METRIC(...)
+#endif
+
 #ifdef LORA_DEBUG
 namespace {
   template<typename T>
@@ -287,6 +294,28 @@ static const char LORA_ERROR_NO_NETWORK[] = "+ERR_NO_NETWORK";
 static const char LORA_ERROR_RX[] = "+ERR_RX";
 static const char LORA_ERROR_UNKNOWN[] = "+ERR_UNKNOWN";
 
+#ifdef LORA_METRICS
+#define LORA_METRICS_CMDS	24	// max distinct commands tracked, last slot collects overflow
+#define LORA_METRICS_SUB	2	// latency histogram precision bits, <= 50% error
+#define LORA_METRICS_EXP	15	// latency histogram range, up to 2^16 ms
+
+/**
+  * Per AT command transport metrics
+  */
+typedef struct {
+	ConstStr cmd;			// command string, e.g. "+CTX"
+	char     type;			// command type, '?' query, '=' set, ' ' send, 0 plain
+	uint32_t count;			// number of commands sent
+	uint32_t timeouts;		// responses timed out
+	uint32_t retries;		// lock-up retries (waitResponse redo)
+	uint32_t errors[7];		// +ERR, _PARAM, _BUSY, _OVERFLOW, _NO_NETWORK, _RX, _UNKNOWN
+	uint32_t bytesOut;		// bytes written to the modem
+	uint32_t bytesIn;		// bytes read from the modem
+	sHistogram_t latency;	// round-trip time in ms, command to response
+	uint32_t bins[HIST_BINS(LORA_METRICS_SUB, LORA_METRICS_EXP)];
+} sATMetric_t;
+#endif
+
 static const char ARDUINO_FW_VERSION[] = "ARD-078 1.2.4";
 static const char ARDUINO_FW_VERSION_AT[] = "ARD-078 1.2.4";
 static const char ARDUINO_FW_IDENTIFIER[] = "ARD-078";
@@ -330,12 +359,33 @@ typedef enum {
     CLASS_C,
 } _lora_class;
 
+typedef enum {
+    TEST_NONE = 0,  // no complete line yet
+    TEST_TXDONE,    // packet sent
+    TEST_RXDONE,    // packet received, RSSI and SNR follow
+    TEST_RXINFO,    // RSSI and SNR of the last packet received
+    TEST_RSSI,      // RSSI measurement
+    TEST_TIMEOUT,   // TX or RX timeout
+    TEST_RXERROR,   // RX error, e.g. CRC
+    TEST_END,       // test command completed
+    TEST_ERROR,     // test command failed
+    TEST_OTHER,     // unknown line
+} _test_event;
+
+#define LORA_TEST_LINE  64  // max length of a test output line
+
+typedef struct {
+    uint32_t cmd;   // micros() at start of the send command
+    uint32_t sent;  // micros() when the last command byte left the UART
+    uint32_t done;  // micros() when the modem reported completion
+} _tx_times;
+
 class LoRaModem : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
 {
 
 public:
   LoRaModem(__attribute__((unused)) Stream& stream = (Stream&)Serial)
-#ifdef SerialLoRa
+#if defined(SerialLoRa) && !defined(LORA_TRACE)
     : stream(SerialLoRa), lastPollTime(millis()), pollInterval(300000)
 #else
     : stream(stream), lastPollTime(millis()), pollInterval(300000)
@@ -348,6 +398,8 @@ public:
 	  formatBin	= false;
 	  adr	= true;
 	  msize = ARDUINO_LORA_MAXBUFF;
+	  testLen = 0;
+	  METRIC(clearMetrics());
     }
 
 public:
@@ -369,6 +421,15 @@ private:
   bool			formatBin;
   bool			adr;
   size_t		msize;
+  _tx_times		txTimes;
+  char			testLine[LORA_TEST_LINE];	// RF test output line in progress
+  uint8_t		testLen;
+#ifdef LORA_METRICS
+  sATMetric_t	metrics[LORA_METRICS_CMDS];
+  sATMetric_t *	metricAct;		// command waiting for its response
+  sATMetric_t *	metricLast;		// last completed command, for trailing reads
+  unsigned long	metricTS;			// time stamp of command start
+#endif
 
 public:
   virtual int joinOTAA(const char *appEui, const char *appKey, const char *devEui, uint32_t timeout) {
@@ -581,6 +642,7 @@ public:
 	if ((!compat_mode && waitResponse(GF(AT_CHANMASK)) == 1)
 			|| (compat_mode && waitResponse() == 1)) {
         channel_mask_str = stream.readStringUntil('\r');
+        METRIC(metricBytesIn(channel_mask_str.length() + 1));
         DBG("### Full channel mask string: ", channel_mask_str);
         sscanf(channel_mask_str.c_str(), "%04hx%04hx%04hx%04hx%04hx%04hx", &channelsMask[0], &channelsMask[1], &channelsMask[2],
                                                     &channelsMask[3], &channelsMask[4], &channelsMask[5]);
@@ -671,10 +733,13 @@ public:
 	sendAT(GF(AT_DEV), GF(AT_QM));
 	if ((ret = waitResponse(GF(AT_DEV),GF(LORA_OK))) == 1 || ret == 2) {
 		fw_version = stream.readStringUntil('\r');
+		METRIC(metricBytesIn(fw_version.length() + 1));
 	}
 	sendAT(GF(AT_VER), GF(AT_QM));
 	if ((ret = waitResponse(GF(AT_VER),GF(LORA_OK))) == 1 || ret == 2) {
-		fw_version += " " + stream.readStringUntil('\r');
+		String ver = stream.readStringUntil('\r');
+		METRIC(metricBytesIn(ver.length() + 1));
+		fw_version += " " + ver;
 	}
     return fw_version;
   }
@@ -847,6 +912,7 @@ public:
 
     sendAT(GF(AT_SEND), " ");
 	stream.write((uint8_t*)buff, len);
+	METRIC(metricBytesOut(len));
 	return (waitResponse() == 1);
   }
 
@@ -856,6 +922,7 @@ public:
 		return false;
     sendAT(GF(AT_SENDB), " ");
 	stream.write((uint8_t*)buff, len);
+	METRIC(metricBytesOut(len));
 	return (waitResponse() == 1);
   }
 
@@ -918,6 +985,163 @@ public:
   bool getJoinStatus() {
     return (getIntValue(GF(AT_NJS)));
   }
+
+  /*
+   * getTxTimes: time stamps of the last uplink send, see modemSend
+   *
+   * Returns: reference to micros() time stamps
+   */
+  const _tx_times & getTxTimes() {
+    return txTimes;
+  }
+
+  /*
+   * testConfig: set LoRa parameters of the RF test commands
+   *
+   * Arguments:	frequency in Hz, power in dBm, bandwidth in kHz (125, 250, 500),
+   * 			spreading factor 7-12, code rate 4/5-8, LNA and PA boost enable
+   *
+   * Returns: true if accepted
+   */
+  bool testConfig(uint32_t frequency, int power, int bandWidth, int spreadFactor,
+      int codeRate, bool lna, bool paBoost) {
+    testLen = 0;
+    sendAT(GF(AT_TCONF), GF(AT_EQ), frequency, ":", power, ":", bandWidth, ":",
+        spreadFactor, ":4/", codeRate, ":", (int)lna, ":", (int)paBoost);
+    return (waitResponse() == 1);
+  }
+
+  /*
+   * testTx, testRx, testRssi, testTone: start an RF test
+   *
+   * The modem reports progress with one line per event and completes the
+   * command after the test, poll with testEvent(). The tone runs until testOff().
+   *
+   * Arguments:	number of packets to send or receive
+   */
+  void testTx(uint16_t count) {
+    testLen = 0;
+    sendAT(GF(AT_TTLRA), GF(AT_EQ), count);
+  }
+
+  void testRx(uint16_t count) {
+    testLen = 0;
+    sendAT(GF(AT_TRLRA), GF(AT_EQ), count);
+  }
+
+  void testRssi() {
+    testLen = 0;
+    sendAT(GF(AT_TRSSI));
+  }
+
+  bool testTone() {
+    testLen = 0;
+    sendAT(GF(AT_TTONE));
+    return (waitResponse() == 1);
+  }
+
+  /*
+   * testOff: stop a running RF test
+   *
+   * Returns: true if stopped
+   */
+  bool testOff() {
+    testLen = 0;
+    sendAT(GF(AT_TOFF));
+    return (waitResponse(3000L) == 1);
+  }
+
+  /*
+   * testEvent: non-blocking read of the RF test output, one line per call
+   *
+   * Arguments:	RSSI in dBm and SNR in dB, set with TEST_RXINFO and TEST_RSSI
+   *
+   * Returns: event of the line read, TEST_NONE if no line is complete
+   */
+  _test_event testEvent(int * rssi, int * snr) {
+    while (stream.available() > 0) {
+      char c = (char)stream.read();
+      if (c != '\r' && c != '\n') {
+        if (testLen < LORA_TEST_LINE - 1)
+          testLine[testLen++] = c;
+        continue;
+      }
+      if (!testLen)
+        continue;
+      testLine[testLen] = '\0';
+      testLen = 0;
+      DBG("### Test:", testLine);
+
+      const char * val;
+      if (strstr(testLine, "OnTxDone"))
+        return TEST_TXDONE;
+      if (strstr(testLine, "OnRxDone"))
+        return TEST_RXDONE;
+      if (strstr(testLine, "Timeout"))
+        return TEST_TIMEOUT;
+      if (strstr(testLine, "OnRxError"))
+        return TEST_RXERROR;
+      if ((val = strstr(testLine, "RssiValue="))) { // RssiValue=-40 dBm, SnrValue=7
+        *rssi = atoi(val + 10);
+        if ((val = strstr(testLine, "SnrValue=")))
+          *snr = atoi(val + 9);
+        return TEST_RXINFO;
+      }
+      if ((val = strstr(testLine, "RSSI Value="))) { // >>> RSSI Value= -110 dBm
+        *rssi = atoi(val + 11);
+        return TEST_RSSI;
+      }
+      if (!strcmp(testLine, LORA_OK) || !strcmp(testLine, "OK"))
+        return TEST_END;
+      if (!strncmp(testLine, LORA_ERROR, sizeof(LORA_ERROR) - 1))
+        return TEST_ERROR;
+      return TEST_OTHER;
+    }
+    return TEST_NONE;
+  }
+
+#ifdef LORA_METRICS
+  /*
+   * printMetrics: print AT transport metrics as CSV, one line per command
+   *
+   * Arguments:	Print target, e.g. debug serial or a host file
+   *
+   * Returns: -
+   */
+  void printMetrics(Print & out) {
+    out.println("cmd;count;timeouts;retries;err;errParam;errBusy;errOverflow;errNoNetwork;errRx;errUnknown;bytesOut;bytesIn;min;mean;p50;p90;p99;max");
+    for (sATMetric_t * m = metrics; m < &metrics[LORA_METRICS_CMDS] && m->count; m++) {
+      // printed field by field, a line does not fit a fixed buffer for all values
+      uint32_t cnt[] = { m->count, m->timeouts, m->retries, m->errors[0], m->errors[1],
+          m->errors[2], m->errors[3], m->errors[4], m->errors[5], m->errors[6],
+          m->bytesOut, m->bytesIn };
+      int32_t lat[] = { (m->latency.count) ? m->latency.min : 0, histMean(&m->latency),
+          histPercentile(&m->latency, 50), histPercentile(&m->latency, 90),
+          histPercentile(&m->latency, 99), (m->latency.count) ? m->latency.max : 0 };
+      out.print("AT");
+      out.print((m->cmd) ? m->cmd : "*");
+      out.print((m->type) ? m->type : ' ');
+      for (uint8_t i = 0; i < sizeof(cnt) / sizeof(cnt[0]); i++) {
+        out.print(';');
+        out.print((unsigned long)cnt[i]);
+      }
+      for (uint8_t i = 0; i < sizeof(lat) / sizeof(lat[0]); i++) {
+        out.print(';');
+        out.print((long)lat[i]);
+      }
+      out.println();
+    }
+  }
+
+  /*
+   * clearMetrics: reset all AT transport metrics
+   */
+  void clearMetrics() {
+    memset(metrics, 0, sizeof(metrics));
+    metricAct = NULL;
+    metricLast = NULL;
+  }
+#endif
   
 private:
 
@@ -985,6 +1209,9 @@ private:
    */
   int modemSend(const void* buff, size_t len, bool confirmed) {
 
+    // no stale split on early errors, the MSIZE query with ADR counts as UART transfer
+    txTimes.cmd = txTimes.sent = txTimes.done = micros();
+
 	if (adr)
     	(void)modemGetMaxSize();
 
@@ -1007,8 +1234,12 @@ private:
     }
     else
     	stream.write((uint8_t*)buff, len);
+    METRIC(metricBytesOut(formatBin ? len*2 : len));
+    stream.flush();	// wait for the payload to leave the UART
+    txTimes.sent = micros();
 
     int8_t rc = waitResponse();
+    txTimes.done = micros();
     if (rc == 1) {            ///< OK
       return len;
     } else if ( rc > 1 ) {    ///< LORA ERROR
@@ -1031,16 +1262,86 @@ private:
     return 0;
   }
 
+#ifdef LORA_METRICS
+  /* Metrics */
+  char metricType() { return 0; }
+
+  template<typename... Args>
+  char metricType(ConstStr next, Args...) { return next[0]; }
+
+  template<typename T, typename... Args>
+  char metricType(T, Args...) { return 0; }
+
+  // Find or allocate metric slot, last slot collects all overflow
+  sATMetric_t * metricFind(ConstStr cmd, char type) {
+    sATMetric_t * m = metrics;
+    for (; m < &metrics[LORA_METRICS_CMDS-1] && m->count; m++)
+      if (m->type == type && (m->cmd == cmd || !strcmp(m->cmd, cmd)))
+        return m;
+    if (!m->count) {
+      m->cmd = (m < &metrics[LORA_METRICS_CMDS-1]) ? cmd : NULL;
+      m->type = (m < &metrics[LORA_METRICS_CMDS-1]) ? type : 0;
+      histInit(&m->latency, m->bins, HIST_BINS(LORA_METRICS_SUB, LORA_METRICS_EXP), LORA_METRICS_SUB, 0);
+    }
+    return m;
+  }
+
+  void metricBegin() {} // empty command, e.g. join trailer
+
+  template<typename... Args>
+  void metricBegin(ConstStr cmd, Args... tail) {
+    if (metricAct)	// e.g. lock-up recovery inside a response
+      return;
+    metricAct = metricFind(cmd, metricType(tail...));
+    metricAct->count++;
+    metricTS = millis();
+  }
+
+  void metricBytesOut(size_t n) {
+    if (metricAct)
+      metricAct->bytesOut += n;
+  }
+
+  void metricBytesIn(size_t n) {
+    sATMetric_t * m = (metricAct) ? metricAct : metricLast;
+    if (m)
+      m->bytesIn += n;
+  }
+
+  void metricRetry() {
+    if (metricAct)
+      metricAct->retries++;
+  }
+
+  void metricEnd(int8_t index, ConstStr match, size_t rcvd) {
+    static const ConstStr errors[] = { LORA_ERROR, LORA_ERROR_PARAM, LORA_ERROR_BUSY, LORA_ERROR_OVERFLOW,
+                                       LORA_ERROR_NO_NETWORK, LORA_ERROR_RX, LORA_ERROR_UNKNOWN };
+    sATMetric_t * m = metricAct;
+    if (!m)	// unsolicited, e.g. maintain()
+      return;
+    m->bytesIn += rcvd;
+    histAdd(&m->latency, (int32_t)(millis() - metricTS));
+    if (index < 0)
+      m->timeouts++;
+    else if (match)
+      for (unsigned i = 0; i < sizeof(errors)/sizeof(ConstStr); i++)
+        if (!strcmp(match, errors[i]))
+          m->errors[i]++;
+    metricLast = m;
+    metricAct = NULL;
+  }
+#endif
+
   /* Utilities */
   template<typename T>
-  void streamWrite(T last) {
-    stream.print(last);
+  size_t streamWrite(T last) {
+    return stream.print(last);
   }
 
   template<typename T, typename... Args>
-  void streamWrite(T head, Args... tail) {
-    stream.print(head);
-    streamWrite(tail...);
+  size_t streamWrite(T head, Args... tail) {
+    size_t n = stream.print(head);
+    return n + streamWrite(tail...);
   }
 
   bool streamSkipUntil(char c, unsigned long timeout = 1000L) {
@@ -1056,7 +1357,9 @@ private:
 
   template<typename... Args>
   void sendAT(Args... cmd) {
-    streamWrite("AT", cmd..., LORA_NL);
+    METRIC(metricBegin(cmd...));
+    size_t n __attribute__((unused)) = streamWrite("AT", cmd..., LORA_NL);
+    METRIC(metricBytesOut(n));
     stream.flush();
     YIELD();
     DBG("### AT:", cmd...);
@@ -1110,6 +1413,7 @@ private:
     int length = 0;
     int a = -1;
     unsigned long startMillis = millis();
+    METRIC(size_t rcvd = 0);
 redo:
 	do {
       YIELD();
@@ -1145,8 +1449,11 @@ redo:
 			  goto finish;
 			} else if ((data.endsWith(GF(AT_RECV))
 					|| data.endsWith(GF(AT_RECVB))) && a == '=') {
-			  downlinkPort = stream.readStringUntil(',').toInt();
-			  length = stream.readStringUntil('\r').toInt();
+			  String port = stream.readStringUntil(',');
+			  String len = stream.readStringUntil('\r');
+			  METRIC(rcvd += port.length() + len.length() + 2);
+			  downlinkPort = port.toInt();
+			  length = len.toInt();
 			  (void)streamSkipUntil('\n');
 			  (void)streamSkipUntil('\n');
 			  if ((uint16_t)length >= msize){
@@ -1157,6 +1464,7 @@ redo:
 			  }
 			  if (data.endsWith(GF(AT_RECVB))){ // Binary receive
 				  char Hi = 0;
+				  METRIC(rcvd += length*2);
 				  for (int i = 0; i < length*2;) {
 					if (stream.available()) {
 						if (!(i%2))
@@ -1167,13 +1475,15 @@ redo:
 					}
 				  }
 			  }
-			  else	// String receive
+			  else {	// String receive
+				  METRIC(rcvd += length);
 				  for (int i = 0; i < length;) {
 					if (stream.available()) {
 						rx.put(stream.read());
 						i++;
 					}
 				  }
+			  }
 			  data = "";
 			  length = 0;
 			  continue;
@@ -1181,8 +1491,10 @@ redo:
         }
         data += (char)stream.read();
         length++;
+        METRIC(rcvd++);
         if ((uint16_t)length >= msize){
         	DBG("### Data string too long:", data);
+        	METRIC(metricEnd(index, NULL, rcvd));
         	return index;
         }
       }
@@ -1193,6 +1505,7 @@ finish:
 		sendAT(GF(""));
 		YIELD();
 		if (a == -1 && stream.available()){
+			METRIC(metricRetry());
 			a--;	// attempt 2
 			startMillis = millis();
 			goto redo;
@@ -1201,6 +1514,13 @@ finish:
 	else if (a != '+') // no follow-up command, get terminator from buffer
 		(void)stream.read();
 
+#ifdef LORA_METRICS
+	{
+		ConstStr rn[] = {r1, r2, r3, r4, r5, r6, r7, r8};
+		metricEnd(index, (index > 0) ? rn[index-1] : NULL, rcvd);
+	}
+#endif
+
     if (index == -1) {
       data.trim();
       if (data.length()) {
@@ -1233,6 +1553,7 @@ finish:
 	if ((!compat_mode && waitResponse(cmd) == 1)
 			|| (compat_mode && waitResponse() == 1)) {
 		value = stream.readStringUntil('\r');
+		METRIC(metricBytesIn(value.length() + 1));
 	}
 	return value;
   }
@@ -1242,7 +1563,9 @@ finish:
 	sendAT(cmd, GF(AT_QM));
 	if ((!compat_mode && waitResponse(cmd) == 1)
 			|| (compat_mode && waitResponse() == 1)) {
-		value = stream.readStringUntil('\r').toInt();
+		String str = stream.readStringUntil('\r');
+		METRIC(metricBytesIn(str.length() + 1));
+		value = str.toInt();
 	}
 	return value;
   }
@@ -1252,7 +1575,9 @@ finish:
 	sendAT(cmd, GF(AT_QM));
 	if ((!compat_mode && waitResponse(cmd) == 1)
 			|| (compat_mode && waitResponse() == 1)) {
-		value = strtoul(stream.readStringUntil('\r').c_str(), NULL, 10);
+		String str = stream.readStringUntil('\r');
+		METRIC(metricBytesIn(str.length() + 1));
+		value = strtoul(str.c_str(), NULL, 10);
 	}
 	return value;
   }
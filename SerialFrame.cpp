@@ -0,0 +1,99 @@
+/*
+ * SerialFrame.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ */
+
+#include "SerialFrame.h"
+
+/********************** HELPERS ************************/
+
+/*
+ * frameCrc: update CRC-16/CCITT-FALSE, polynomial 0x1021
+ *
+ * Arguments: - CRC value so far, start with 0xFFFF
+ * 			  - byte buffer
+ * 			  - length of byte buffer
+ *
+ * Return:	  - updated CRC value
+ */
+static uint16_t
+frameCrc(uint16_t crc, const uint8_t * buf, uint8_t len){
+	while (len--){
+		crc ^= (uint16_t)*buf++ << 8;
+		for (int i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+/*************** FRAME FUNCTIONS ********************/
+
+/*
+ * frameRead: read a frame, STX has already been consumed
+ *
+ * Arguments: - input stream
+ * 			  - pointer to store frame type
+ * 			  - payload buffer of FRAME_MAXLEN bytes
+ * 			  - pointer to store payload length
+ *
+ * Return:	  - FRAME_EOK if OK, frame error code otherwise
+ */
+int
+frameRead(Stream & in, uint8_t * type, uint8_t * buf, uint8_t * len){
+	uint8_t hdr[2];
+	uint8_t crc[2];
+
+	if (in.readBytes((char *)hdr, sizeof(hdr)) != sizeof(hdr))
+		return FRAME_ETIME;
+	*type = hdr[0];
+	*len = hdr[1];
+
+	if (in.readBytes((char *)buf, *len) != *len
+			|| in.readBytes((char *)crc, sizeof(crc)) != sizeof(crc))
+		return FRAME_ETIME;
+
+	uint16_t chk = frameCrc(frameCrc(0xFFFF, hdr, sizeof(hdr)), buf, *len);
+	if (chk != (uint16_t)(crc[0] | crc[1] << 8))
+		return FRAME_ECRC;
+
+	return FRAME_EOK;
+}
+
+/*
+ * frameWrite: write a frame
+ *
+ * Arguments: - output target
+ * 			  - frame type
+ * 			  - payload buffer
+ * 			  - payload length
+ *
+ * Return:	  -
+ */
+void
+frameWrite(Print & out, uint8_t type, const uint8_t * buf, uint8_t len){
+	uint8_t hdr[3] = { FRAME_STX, type, len };
+	uint16_t crc = frameCrc(frameCrc(0xFFFF, &hdr[1], 2), buf, len);
+	uint8_t chk[2] = { (uint8_t)crc, (uint8_t)(crc >> 8) };
+
+	out.write(hdr, sizeof(hdr));
+	out.write(buf, len);
+	out.write(chk, sizeof(chk));
+}
+
+/*
+ * frameReply: write an ACK or NAK reply frame
+ *
+ * Arguments: - output target
+ * 			  - type of the request frame
+ * 			  - error code, FRAME_EOK for ACK
+ * 			  - offending tag for NAK, 0 if none
+ *
+ * Return:	  -
+ */
+void
+frameReply(Print & out, uint8_t type, uint8_t code, uint8_t tag){
+	uint8_t buf[3] = { type, code, tag };
+	frameWrite(out, (code == FRAME_EOK) ? FRAME_ACK : FRAME_NAK, buf, sizeof(buf));
+}
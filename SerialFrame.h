@@ -0,0 +1,42 @@
+/*
+ * SerialFrame.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ *
+ *  Binary frames on the debug serial, used for configuration upload and binary result streams.
+ *
+ *  Frame format:
+ *  	STX		0x02
+ *  	type	1 byte frame type
+ *  	length	1 byte payload length
+ *  	payload	length bytes
+ *  	CRC		CRC-16/CCITT-FALSE over type, length and payload, little endian
+ */
+
+#ifndef SERIALFRAME_H_
+#define SERIALFRAME_H_
+
+#include <stdint.h>
+#include "main.h"
+
+#define FRAME_STX		0x02	// frame start
+#define FRAME_ACK		0x06	// reply type, request accepted
+#define FRAME_NAK		0x15	// reply type, request rejected
+#define FRAME_MAXLEN	255		// max payload length
+
+// Frame error codes, also returned in NAK replies
+#define FRAME_EOK		0		// no error
+#define FRAME_ETIME		1		// frame incomplete, serial timeout
+#define FRAME_ECRC		2		// CRC mismatch
+#define FRAME_ETYPE		3		// unknown frame type
+#define FRAME_ETAG		4		// unknown tag or wrong tag length
+#define FRAME_EVAL		5		// value out of range
+#define FRAME_EBUSY		6		// not possible while a test is running
+#define FRAME_EFULL		7		// no space left
+
+int frameRead(Stream & in, uint8_t * type, uint8_t * buf, uint8_t * len);
+void frameWrite(Print & out, uint8_t type, const uint8_t * buf, uint8_t len);
+void frameReply(Print & out, uint8_t type, uint8_t code, uint8_t tag);
+
+#endif /* SERIALFRAME_H_ */
@@ -0,0 +1,118 @@
+/*
+ * Arduino.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ */
+
+#include "Arduino.h"
+#include "LoRa.h"
+
+#include <time.h>
+
+volatile uint32_t REG_PORT_DIRSET0;
+volatile uint32_t REG_PORT_OUTSET0;
+volatile uint32_t REG_PORT_OUTCLR0;
+
+HostConsole SerialUSB;
+HostPort Serial;
+HostPort Serial1;
+HostPort SerialLoRaPort;
+LoRaClass LoRa;
+
+#define FASTTICK	10			// us the virtual clock advances per read in fast mode
+
+static bool fastClock;			// skip waits instead of sleeping
+static uint64_t clockSkip;		// total time skipped in us
+static uint64_t clockStart;		// wall time at first call
+
+/*
+ * hostWallMicros: monotonic wall clock in us
+ *
+ * Arguments: -
+ *
+ * Return:	  - time in us
+ */
+uint64_t
+hostWallMicros(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/*
+ * hostClockFast: set virtual clock to skip waits
+ *
+ * Arguments: - true to skip, false to sleep in real time
+ *
+ * Return:	  -
+ */
+void
+hostClockFast(bool fast){
+	fastClock = fast;
+}
+
+/*
+ * hostClockSkip: advance virtual clock
+ *
+ * Arguments: - time to skip in us
+ *
+ * Return:	  -
+ */
+void
+hostClockSkip(uint32_t us){
+	clockSkip += us;
+}
+
+/*
+ * hostMicros: virtual clock in us, wall clock plus skipped time
+ *
+ * Arguments: -
+ *
+ * Return:	  - time in us
+ *
+ * Note: in fast mode, every read advances the clock a tick such that
+ * 		 busy-waits on millis() end without waiting in real time.
+ */
+static uint64_t
+hostMicros(){
+	if (!clockStart)
+		clockStart = hostWallMicros();
+	if (fastClock)
+		clockSkip += FASTTICK;
+	return hostWallMicros() - clockStart + clockSkip;
+}
+
+uint32_t
+millis(){
+	return (uint32_t)(hostMicros() / 1000);
+}
+
+uint32_t
+micros(){
+	return (uint32_t)hostMicros();
+}
+
+void
+delayMicroseconds(unsigned int us){
+	if (fastClock){
+		hostClockSkip(us);
+		return;
+	}
+	struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+	nanosleep(&ts, NULL);
+}
+
+void
+delay(unsigned long ms){
+	while (ms){
+		unsigned long chunk = min(ms, 1000ul);
+		delayMicroseconds((unsigned int)chunk * 1000);
+		ms -= chunk;
+	}
+}
+
+void pinMode(uint32_t, uint32_t) {}
+void digitalWrite(uint32_t, uint32_t) {}
+void noInterrupts() {}
+void interrupts() {}
@@ -0,0 +1,257 @@
+/*
+ * Arduino.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ *
+ *  Minimal Arduino core replacement to build and run the test firmware on
+ *  Linux, e.g. for the trace replay. Only what the firmware uses is provided.
+ */
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define DEC			10
+#define HEX			16
+#define LOW			0
+#define HIGH		1
+#define OUTPUT		1
+#define SERIAL_8N1	0x13
+#define SERIAL_8N2	0x17
+
+#define LORA_IRQ_DUMB	0	// MKR WAN pins, no function on host
+#define LORA_BOOT0		0
+#define LORA_RESET		0
+#define PORT_PA20		(1ul << 20)
+
+#define min(a,b)	((a)<(b)?(a):(b))
+#define max(a,b)	((a)>(b)?(a):(b))
+
+extern volatile uint32_t REG_PORT_DIRSET0;
+extern volatile uint32_t REG_PORT_OUTSET0;
+extern volatile uint32_t REG_PORT_OUTCLR0;
+
+// 32 bit time base as on the Cortex M0+, virtual clock when running fast
+uint32_t millis();
+uint32_t micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t val);
+void noInterrupts();
+void interrupts();
+
+/*
+ * String, subset of the Arduino String class
+ */
+class String
+{
+public:
+	String(const char * cstr = "") : s((cstr) ? cstr : "") {}
+	String(const std::string & str) : s(str) {}
+
+	void reserve(size_t size) { s.reserve(size); }
+	unsigned int length() const { return (unsigned int)s.size(); }
+	const char * c_str() const { return s.c_str(); }
+	long toInt() const { return atol(s.c_str()); }
+	void concat(const char * cstr) { s += cstr; }
+	int compareTo(const String & str) const { return s.compare(str.s); }
+	int indexOf(const String & str) const {
+		size_t pos = s.find(str.s);
+		return (pos == std::string::npos) ? -1 : (int)pos;
+	}
+	bool endsWith(const String & str) const {
+		return s.size() >= str.s.size() && !s.compare(s.size() - str.s.size(), str.s.size(), str.s);
+	}
+	String substring(unsigned int from) const { return (from < s.size()) ? s.substr(from) : ""; }
+	String substring(unsigned int from, unsigned int to) const {
+		return (from < s.size() && to > from) ? s.substr(from, to - from) : "";
+	}
+	void trim() {
+		size_t b = s.find_first_not_of(" \t\r\n");
+		size_t e = s.find_last_not_of(" \t\r\n");
+		s = (b == std::string::npos) ? "" : s.substr(b, e - b + 1);
+	}
+
+	String & operator += (char c) { s += c; return *this; }
+	String & operator += (const String & str) { s += str.s; return *this; }
+	bool operator == (const String & str) const { return s == str.s; }
+	bool operator != (const String & str) const { return s != str.s; }
+	friend String operator + (const String & lhs, const String & rhs) { return lhs.s + rhs.s; }
+
+private:
+	std::string s;
+};
+
+/*
+ * Print, subset of the Arduino Print class
+ */
+class Print // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t * buffer, size_t size) {
+		size_t n = 0;
+		while (size-- && write(*buffer++))
+			n++;
+		return n;
+	}
+	size_t write(const char * str) { return (str) ? write((const uint8_t *)str, strlen(str)) : 0; }
+	virtual void flush() {}
+
+	size_t print(const char * str) { return write(str); }
+	size_t print(const String & str) { return write(str.c_str()); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(int n, int base = DEC) { return print((long)n, base); }
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(long n, int base = DEC) {
+		char buf[24];
+		snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%ld", n);
+		return write(buf);
+	}
+	size_t print(unsigned long n, int base = DEC) {
+		char buf[24];
+		snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%lu", n);
+		return write(buf);
+	}
+	size_t print(double n, int digits = 2) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.*f", digits, n);
+		return write(buf);
+	}
+
+	size_t println() { return write("\r\n"); }
+	template<typename T> size_t println(T val) { size_t n = print(val); return n + println(); }
+	template<typename T> size_t println(T val, int fmt) { size_t n = print(val, fmt); return n + println(); }
+};
+
+/*
+ * Stream, subset of the Arduino Stream class
+ */
+class Stream : public Print // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+	Stream() : timeout(1000) {}
+
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	void setTimeout(unsigned long ms) { timeout = ms; }
+
+	size_t readBytes(char * buffer, size_t length) {
+		size_t n = 0;
+		int c;
+		while (n < length && (c = timedRead()) >= 0)
+			buffer[n++] = (char)c;
+		return n;
+	}
+	size_t readBytes(uint8_t * buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+	size_t readBytesUntil(char terminator, char * buffer, size_t length) {
+		size_t n = 0;
+		int c;
+		while (n < length && (c = timedRead()) >= 0 && c != terminator)
+			buffer[n++] = (char)c;
+		return n;
+	}
+
+	String readStringUntil(char terminator) {
+		String ret;
+		int c;
+		while ((c = timedRead()) >= 0 && c != terminator)
+			ret += (char)c;
+		return ret;
+	}
+
+protected:
+	unsigned long timeout;
+
+	int timedRead() {
+		uint32_t start = millis();
+		do {
+			int c = read();
+			if (c >= 0)
+				return c;
+		} while (millis() - start < timeout);
+		return -1;
+	}
+};
+
+/*
+ * HostConsole: debug serial, output to stdout, input from a command string
+ */
+class HostConsole : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+	HostConsole() : quiet(false), pos(0) {}
+
+	void begin(unsigned long) {}
+	void end() {}
+	operator bool() { return true; }
+
+	virtual int available() { return (int)(input.size() - pos); }
+	virtual int read() { return (pos < input.size()) ? (uint8_t)input[pos++] : -1; }
+	virtual int peek() { return (pos < input.size()) ? (uint8_t)input[pos] : -1; }
+	virtual size_t write(uint8_t c) { return (quiet) ? 1 : fwrite(&c, 1, 1, stdout); }
+	using Print::write;
+
+	void setInput(const char * str) { input += str; }
+	void setInput(const char * str, size_t len) { input.append(str, len); }
+	void setQuiet(bool q) { quiet = q; }
+
+private:
+	bool quiet;
+	std::string input;
+	size_t pos;
+};
+
+/*
+ * HostPort: hardware serial forwarding to an attached stream, e.g. the replay
+ */
+class HostPort : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+	HostPort() : port(NULL) {}
+
+	void begin(unsigned long, uint16_t = SERIAL_8N1) {}
+	void end() {}
+	operator bool() { return true; }
+
+	virtual int available() { return (port) ? port->available() : 0; }
+	virtual int read() { return (port) ? port->read() : -1; }
+	virtual int peek() { return (port) ? port->peek() : -1; }
+	virtual size_t write(uint8_t c) { return (port) ? port->write(c) : 1; }
+	using Print::write;
+	virtual void flush() { if (port) port->flush(); }
+
+	void attach(Stream * stream) { port = stream; }
+
+private:
+	Stream * port;
+};
+
+extern HostConsole SerialUSB;
+extern HostPort Serial;
+extern HostPort Serial1;
+extern HostPort SerialLoRaPort;
+#define SerialLoRa SerialLoRaPort
+
+// Host control of the virtual clock
+void hostClockFast(bool fast);
+void hostClockSkip(uint32_t us);
+uint64_t hostWallMicros();
+
+#endif /* HOST_ARDUINO_H_ */
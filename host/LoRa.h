@@ -0,0 +1,59 @@
+/*
+ * LoRa.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ *
+ *  Inert replacement of the LoRa library for host builds, mode 1 does not transmit.
+ */
+
+#ifndef HOST_LORA_H_
+#define HOST_LORA_H_
+
+#include "Arduino.h"
+
+#define PA_OUTPUT_RFO_PIN		0
+#define PA_OUTPUT_PA_BOOST_PIN	1
+
+class LoRaClass : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+	int begin(long) { return 1; }
+	void end() {}
+
+	int beginPacket(int = false) { return 1; }
+	int endPacket(bool = false) { return 1; }
+	int parsePacket(int = 0) { return 0; }
+	int packetRssi() { return -157; }
+	float packetSnr() { return 0; }
+	int rssi() { return -157; }
+	uint8_t random() { return (uint8_t)::random(); }
+
+	virtual size_t write(uint8_t) { return 1; }
+	virtual size_t write(const uint8_t *, size_t size) { return size; }
+	virtual int available() { return 0; }
+	virtual int read() { return -1; }
+	virtual int peek() { return -1; }
+
+	void onReceive(void(*)(int)) {}
+	void onTxDone(void(*)()) {}
+	void receive(int = 0) {}
+	void idle() {}
+	void sleep() {}
+
+	void setTxPower(int, int = PA_OUTPUT_PA_BOOST_PIN) {}
+	void setFrequency(long) {}
+	void setSpreadingFactor(int) {}
+	void setSignalBandwidth(long) {}
+	void setCodingRate4(int) {}
+	void setPreambleLength(long) {}
+	void setSyncWord(int) {}
+	void enableCrc() {}
+	void disableCrc() {}
+	void enableInvertIQ() {}
+	void disableInvertIQ() {}
+};
+
+extern LoRaClass LoRa;
+
+#endif /* HOST_LORA_H_ */
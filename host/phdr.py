@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+#
+# phdr.py
+#
+#  Created on: Oct 18, 2026
+#      Author: Florian Hofer
+#
+#  Decode the test payload header (CM_PHDR) from network server exports and
+#  compute per-test loss and latency distributions.
+#
+#  usage: phdr.py [-p field] [-t field] [-c] export.{json,jsonl,csv}
+#  	-p	payload field, hex or base64, default: first of data, frm_payload, payload
+#  	-t	receive time field, ISO 8601 or epoch s/ms, default: first of
+#  		received_at, time, ts, timestamp
+#  	-c	print one CSV line per packet instead of the summary
+#
+#  Header layout, little endian: u8 0xA1, u16 test ID, u32 sequence, u32 node send time in ms.
+#  The sequence restarts from 0 at every R and campaign step, a sequence lower than the last one
+#  of the test ID in receive order thus starts a new group, as on the PER receiver (mode 6).
+#  The node clock is free running, latencies are thus relative to the fastest packet of a group
+#  (min(rx - tx) = 0), i.e. the distribution of the one-way latency above its minimum.
+
+import argparse
+import base64
+import binascii
+import csv
+import json
+import struct
+import sys
+from datetime import datetime
+
+PHDRVER = 0xA1
+PHDRFMT = '<BHII'
+PHDRLEN = struct.calcsize(PHDRFMT)
+
+PAYLOADKEYS = ('data', 'frm_payload', 'payload')
+TIMEKEYS = ('received_at', 'time', 'ts', 'timestamp')
+
+
+def lookup(rec, keys):
+    """Find first key in a possibly nested record, e.g. uplink_message.frm_payload."""
+    for key in keys:
+        node = rec
+        for part in key.split('.'):
+            if not isinstance(node, dict) or part not in node:
+                break
+            node = node[part]
+        else:
+            return node
+    for value in rec.values():
+        if isinstance(value, dict):
+            found = lookup(value, keys)
+            if found is not None:
+                return found
+    return None
+
+
+def decodePayload(value):
+    try:
+        if len(value) % 2 == 0:
+            return binascii.unhexlify(value)
+    except (binascii.Error, TypeError):
+        pass
+    try:
+        return base64.b64decode(value, validate=True)
+    except (binascii.Error, TypeError):
+        return None
+
+
+def decodeTime(value):
+    """Return receive time in ms."""
+    try:
+        num = float(value)
+        return num if num > 1e11 else num * 1000.0
+    except (TypeError, ValueError):
+        pass
+    text = str(value).replace('Z', '+00:00')
+    if '.' in text:  # fromisoformat accepts at most 6 fraction digits
+        head, _, tail = text.partition('.')
+        digits = ''.join(c for c in tail if c.isdigit())
+        text = head + '.' + digits[:6].ljust(6, '0') + tail[len(digits):]
+    return datetime.fromisoformat(text).timestamp() * 1000.0
+
+
+def readRecords(path):
+    with open(path, newline='') as f:
+        if path.endswith('.csv'):
+            yield from csv.DictReader(f)
+            return
+        text = f.read().strip()
+        if text.startswith('['):
+            yield from json.loads(text)
+            return
+        for line in text.splitlines():
+            if line.strip():
+                yield json.loads(line)
+
+
+def percentile(values, pct):
+    if not values:
+        return 0
+    idx = max(0, -(-len(values) * pct // 100) - 1)  # rank rounded up
+    return values[int(idx)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode test payload headers')
+    parser.add_argument('-p', dest='payload', help='payload field')
+    parser.add_argument('-t', dest='time', help='receive time field')
+    parser.add_argument('-c', dest='csv', action='store_true', help='per packet CSV output')
+    parser.add_argument('export')
+    args = parser.parse_args()
+
+    pKeys = (args.payload,) if args.payload else PAYLOADKEYS
+    tKeys = (args.time,) if args.time else TIMEKEYS
+
+    recs = []
+    skipped = 0
+    for rec in readRecords(args.export):
+        raw = lookup(rec, pKeys)
+        rxTime = lookup(rec, tKeys)
+        data = decodePayload(raw) if raw is not None else None
+        if data is None or rxTime is None or len(data) < PHDRLEN or data[0] != PHDRVER:
+            skipped += 1
+            continue
+        _, testId, seq, txTime = struct.unpack_from(PHDRFMT, data)
+        recs.append((decodeTime(rxTime), testId, seq, txTime))
+
+    # group by test ID and restart, in receive order
+    groups = {}
+    last = {}
+    for rxTime, testId, seq, txTime in sorted(recs):
+        runs = groups.setdefault(testId, [])
+        if not runs or seq < last[testId]:
+            runs.append([])
+        runs[-1].append((seq, txTime, rxTime))
+        last[testId] = seq
+
+    if args.csv:
+        print('test;group;seq;tx;rx;latency')
+    else:
+        print('test;group;received;expected;lost;duplicates;loss%;min;p50;p90;p99;max')
+
+    for testId in sorted(groups):
+        for group, pkts in enumerate(groups[testId]):
+            pkts.sort()
+            offset = min(rx - tx for _, tx, rx in pkts)
+            if args.csv:
+                for seq, tx, rx in pkts:
+                    print('%u;%u;%u;%u;%.0f;%.0f' % (testId, group, seq, tx, rx, rx - tx - offset))
+                continue
+
+            # the sequence counts from 0, packets lost before the first received one included
+            seqs = set(seq for seq, _, _ in pkts)
+            expected = max(seqs) + 1
+            lost = expected - len(seqs)
+            lat = sorted(rx - tx - offset for _, tx, rx in pkts)
+            print('%u;%u;%u;%u;%u;%u;%.2f;%.0f;%.0f;%.0f;%.0f;%.0f' % (
+                testId, group, len(seqs), expected, lost, len(pkts) - len(seqs),
+                100.0 * lost / expected, lat[0], percentile(lat, 50),
+                percentile(lat, 90), percentile(lat, 99), lat[-1]))
+
+    if skipped:
+        print('%u records without header skipped' % skipped, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
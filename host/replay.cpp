@@ -0,0 +1,117 @@
+/*
+ * replay.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Florian Hofer
+ *
+ *  Host driver running the test firmware against a recorded modem trace.
+ *
+ *  usage: replay [-f] [-q] [-g grace_ms] trace.lrt "menu commands"
+ *  	-f	fast, skip all waits instead of keeping the recorded pace
+ *  	-q	quiet, do not print the firmware output
+ *  	-g	time to keep running after the trace ended, default 10000 ms
+ *
+ *  Returns 0 if all host writes matched the trace, 1 on mismatch, 2 on error.
+ */
+
+#include "Arduino.h"
+#include "LoRaTrace.h"
+
+#include <unistd.h>
+
+void setup();
+void loop();
+
+/*
+ * FileStream: read-only stream on a trace file
+ */
+class FileStream : public Stream // @suppress("Class has a virtual method and non-virtual destructor")
+{
+public:
+	FileStream(FILE * file) : file(file) {}
+
+	virtual int available() { return !feof(file); }
+	virtual int read() { return fgetc(file); }
+	virtual int peek() {
+		int c = fgetc(file);
+		if (c >= 0)
+			ungetc(c, file);
+		return c;
+	}
+	virtual size_t write(uint8_t) { return 0; }
+	using Print::write;
+
+private:
+	FILE * file;
+};
+
+int
+main(int argc, char ** argv){
+	bool fast = false;
+	bool quiet = false;
+	uint32_t grace = 10000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "fqg:")) != -1){
+		switch (opt){
+		case 'f': fast = true;
+			break;
+		case 'q': quiet = true;
+			break;
+		case 'g': grace = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f] [-q] [-g grace_ms] trace.lrt \"commands\"\n", argv[0]);
+			return 2;
+		}
+	}
+	if (argc - optind != 2){
+		fprintf(stderr, "usage: %s [-f] [-q] [-g grace_ms] trace.lrt \"commands\"\n", argv[0]);
+		return 2;
+	}
+
+	FILE * file = fopen(argv[optind], "rb");
+	if (!file){
+		perror(argv[optind]);
+		return 2;
+	}
+
+	FileStream trace(file);
+	trace.setTimeout(0);
+	LoRaReplayStream replay(trace, (fast) ? hostClockSkip : NULL);
+	if (!replay.begin()){
+		fprintf(stderr, "%s: not a modem trace\n", argv[optind]);
+		return 2;
+	}
+
+	hostClockFast(fast);
+	SerialUSB.setQuiet(quiet);
+	SerialLoRa.attach(&replay);
+
+	uint64_t wallStart = hostWallMicros();
+	uint32_t virtStart = millis();
+
+	setup();
+	SerialUSB.setInput(argv[optind+1]);
+
+	unsigned long loops = 0;
+	uint32_t endTS = 0;
+	while (!replay.done() || millis() - endTS < grace){
+		uint32_t io = replay.getTxBytes() + replay.getRxBytes();
+		loop();
+		loops++;
+		if (fast && io == replay.getTxBytes() + replay.getRxBytes())
+			hostClockSkip(1000);	// idle loop, advance 1 ms
+		if (!replay.done())
+			endTS = millis();
+	}
+
+	double wall = (double)(hostWallMicros() - wallStart) / 1e6;
+	fprintf(stderr, "replay: %lu loops, %.3f s virtual, %.3f s wall, %.3f us/loop, "
+			"%u bytes tx, %u bytes rx, %u mismatches, %u bytes after trace end\n",
+			loops, (double)(millis() - virtStart) / 1e3, wall, wall * 1e6 / (double)loops,
+			replay.getTxBytes(), replay.getRxBytes(), replay.getMismatch(), replay.getOverrun());
+
+	fclose(file);
+	return (replay.getMismatch()) ? 1 : 0;
+}
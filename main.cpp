@@ -7,11 +7,60 @@
 
 #include "main.h"
 #include "LoRaMgmt.h"			// LoRaWan modem management
+#include "SerialFrame.h"		// binary configuration frames
+
+#include <inttypes.h>			// print formats, same output on host builds
 
 #define TST_MXRSLT	30			// What's the max number of test results we allow?
 #define LEDBUILDIN	PORT_PA20	// MKRWan1300 build in led position
 #define KEYBUFF		83			// Max total usage of key buffers = 32 + 32 + 16 + 3*\0
 #define KEYSIZE		32			// 32
+
+// Binary configuration frame, type and TLV tags, values little endian
+#define CFG_FRAME	'C'			// frame type configuration
+#define CFG_MODE	0x01		// u8 test mode, resets settings to mode defaults, send first
+#define CFG_CONFMSK	0x02		// u8 configuration mask bits
+#define CFG_POWER	0x03		// u8 Tx power index
+#define CFG_DATALEN	0x04		// u8 data length
+#define CFG_REPEAT	0x05		// u8 send repeat count
+#define CFG_RXWIN1	0x06		// u16 RX1 window delay in ms
+#define CFG_FRQMSK	0x07		// u16 frequency (LoRa) or channel mask (LoRaWan), mask 0 = last scan
+#define CFG_DRSF	0x08		// u8 data rate (LoRaWan) or spread factor (LoRa)
+#define CFG_BW		0x09		// u8 bandwidth (LoRa)
+#define CFG_CR		0x0A		// u8 code rate 4/x (LoRa)
+#define CFG_PREAMB	0x0B		// u16 preamble length (LoRa)
+#define CFG_PAYMODE	0x0C		// u8 payload generator mode
+#define CFG_SEED	0x0D		// u32 payload generator seed, 0 = derive from data length
+#define CFG_TESTID	0x0E		// u16 test identifier in the payload header
+#define CFG_HOPS	0x13		// hop table (LoRa), 5 bytes per entry, u16 frequency, u8 SF, BW, CR
+#define CFG_RFTEST	0x14		// u8 modem RF test, RT_* (mode 7)
+#define CFG_RFCOUNT	0x15		// u16 packets per modem RF test (mode 7)
+#define CFG_SCANDWL	0x16		// u16 dwell time per channel in ms (mode 8)
+#define CFG_BUSYLVL	0x17		// u8 busy RSSI level in -dBm (mode 1 LBT, mode 8)
+#define CFG_LBTBOFF	0x18		// u16 LBT max back-off in ms (mode 1)
+#define CFG_RTRPOL	0x19		// u8 retry back-off policy, RP_* (LoRaWan)
+#define CFG_RTRDLY	0x1A		// u16 retry back-off base in ms (LoRaWan)
+#define CFG_ARRIVAL	0x1B		// u8 packet arrival process, AP_* (LoRaWan)
+#define CFG_ARRPER	0x1C		// u16 mean inter-arrival time in 100 ms (LoRaWan)
+#define CFG_ARRJIT	0x1D		// u8 periodic arrival jitter in +- percent (LoRaWan)
+#define CFG_BURSTLN	0x1E		// u8 packets per burst (LoRaWan)
+#define CFG_LENDIST	0x1F		// u8 payload length distribution, LD_* (LoRaWan)
+#define CFG_LENMIN	0x21		// u8 shortest payload of the length distribution (LoRaWan)
+#define CFG_SLOTLEN	0x22		// u16 slot length in ms, 0 = pure ALOHA (LoRaWan)
+#define CFG_SLOTIDX	0x23		// u8 slot of the node in the frame (LoRaWan)
+#define CFG_SLOTCNT	0x24		// u8 slots per frame (LoRaWan)
+#define CFG_RMTLSTN	0x25		// u8 listen in class C for remote commands [0-1] (mode 3)
+#define CFG_KEY1	0x10		// 8/16 bytes app EUI (OTAA) or network session key (ABP)
+#define CFG_KEY2	0x11		// 16 bytes app key (OTAA) or application session key (ABP)
+#define CFG_KEY3	0x12		// 4/8 bytes device address (ABP) or device EUI (OTAA)
+#define CFG_RUN		0x20		// no value, start test after applying the configuration
+#define CFG_QUEUE	'Q'			// frame type append configuration to queue, empty payload clears
+#define CFG_QUEUESZ	1024		// configuration queue size, entries are length + TLV payload
+#define CFG_SWEEP	'W'			// frame type sweep descriptor, empty payload clears
+#define CFG_SWPAXES	6			// max number of sweep axes
+#define CFG_SWPRNG	'r'			// sweep axis kind range, u16 start, stop, step
+#define CFG_SWPLST	'l'			// sweep axis kind list, u8 count, u16 values
+#define CFG_IDENT	'I'			// frame type append ABP identities, LORAIDLEN bytes each, empty clears
 /* Strings 		*/
 
 const char prtSttStart[] PROGMEM = "Start test\n";
@@ -28,6 +77,9 @@ const char prtSttErrExec[] PROGMEM = "ERROR: during state execution\n";
 const char prtSttErrText[] PROGMEM = "ERROR: test malfunction\n";
 const char prtSttSelect[] PROGMEM = "Select Test:\n";
 const char prtSttResults[] PROGMEM = "Results:\n";
+const char prtSttStats[] PROGMEM = "Statistics:\n";
+const char prtSttConfig[] PROGMEM = "Config: ";
+const char prtSttErrQueue[] PROGMEM = "ERROR: queued configuration invalid\n";
 
 const char prtTblCR[] PROGMEM = " CR 4/";
 const char prtTblDR[] PROGMEM = " DR ";
@@ -39,8 +91,25 @@ const char prtTblSnr[] PROGMEM = " snr ";
 const char prtTblTTx[] PROGMEM = " Time TX: ";
 const char prtTblTRx[] PROGMEM = " Time RX: ";
 const char prtTblTTl[] PROGMEM = " Time Total: ";
+const char prtTblTHst[] PROGMEM = " TX Host: ";
+const char prtTblTUart[] PROGMEM = " TX UART: ";
+const char prtTblTMdm[] PROGMEM = " TX Modem: ";
 const char prtTblTms[] PROGMEM = " ms";
 
+const char prtHstTTx[] PROGMEM = "TimeTX";
+const char prtHstTToRx[] PROGMEM = "TimeToRX";
+const char prtHstTRx[] PROGMEM = "TimeRX";
+const char prtHstRssi[] PROGMEM = "RSSI";
+const char prtHstSnr[] PROGMEM = "SNR";
+const char prtHstTGap[] PROGMEM = "TXGap";
+const char prtHstArrGap[] PROGMEM = "ArrGap";
+const char prtHstArrLag[] PROGMEM = "ArrLag";
+const char prtHstHop[] PROGMEM = "Hop";
+const char prtHstPer[] PROGMEM = "PER";
+const char prtHstRfTest[] PROGMEM = "RFTest";
+const char prtHstScan[] PROGMEM = "Scan";
+const char prtHstId[] PROGMEM = "Id";
+
 /* Locals 		*/
 
 // Working variables
@@ -48,6 +117,33 @@ static sLoRaResutls_t testResults[TST_MXRSLT];	// Storage for test results
 static sLoRaConfiguration_t newConf;			// test Configuration
 static char keyArray[KEYBUFF];					// static array containing init keys
 
+// Configuration queue, test campaign
+static uint8_t cfgQueue[CFG_QUEUESZ];			// queued TLV configurations
+static uint16_t cfgQueueLen;					// bytes used in queue
+static uint16_t cfgQueuePos;					// position of next entry to run
+static int cfgIndex = -1;						// index of running queued configuration, -1 none
+static sLoRaConfiguration_t cfgBase;			// configuration at first upload, campaign start
+static char cfgBaseKeys[KEYBUFF];				// keys at first upload
+static sLoRaConfiguration_t cfgShadow;			// configuration after all queued entries, validation
+static char cfgShadowKeys[KEYBUFF];				// keys after all queued entries
+
+/**
+  * Sweep axis, values of a configuration tag expanded at runtime
+  */
+typedef struct {
+	uint8_t tag;		// configuration tag, numeric entries only
+	uint8_t size;		// value size in bytes
+	uint16_t count;		// number of values
+	uint16_t pos;		// index of the next value
+	uint16_t start;		// range start value, or list offset in swpList
+	uint16_t step;		// range step, 0 for lists
+} sSweepAxis_t;
+
+static sSweepAxis_t swpAxes[CFG_SWPAXES];		// sweep descriptor axes, last axis changes fastest
+static uint8_t swpCount;						// number of sweep axes, 0 = no sweep
+static uint16_t swpList[FRAME_MAXLEN/2];		// list values of all list axes
+static bool swpDone;							// all sweep combinations run
+
 /* 	Globals		*/
 
 int debug = 1;			// print debug
@@ -77,6 +173,41 @@ printScaled(uint32_t value, uint32_t Scale = 1000){
 		debugSerial.print(value);
 }
 
+/*
+ * perMille(): ratio in 1/1000, for percent with one decimal
+ *
+ * Arguments:	- part
+ * 				- whole
+ *
+ * Return:		- part per mille of whole, 0 if whole is 0
+ */
+static uint32_t
+perMille(uint64_t part, uint64_t whole){
+	return (whole) ? (uint32_t)(part * 1000 / whole) : 0;
+}
+
+/*
+ * printEfficiency(): print goodput and wall time shares
+ *
+ * Arguments:	- buffer to append to
+ * 				- payload bytes delivered
+ * 				- wall time in ms
+ * 				- air time in ms
+ * 				- wait time in ms
+ *
+ * Return:		-
+ */
+static void
+printEfficiency(char * buf, uint32_t bytes, uint64_t wall, uint64_t air, uint64_t wait){
+	// AT overhead is the rest, modem round trips, processing and host
+	uint64_t at = (air + wait < wall) ? wall - air - wait : 0;
+	uint32_t gput = (wall) ? (uint32_t)((uint64_t)bytes * 100000 / wall) : 0;	// in B/s * 100
+	uint32_t atPm = perMille(at, wall), airPm = perMille(air, wall), waitPm = perMille(wait, wall);
+	sprintf(buf + strlen(buf), ";%" PRIu32 ".%02" PRIu32 ";%" PRIu32 ".%" PRIu32 ";%" PRIu32 ".%" PRIu32
+			";%" PRIu32 ".%" PRIu32, gput / 100, gput % 100, atPm / 10, atPm % 10,
+			airPm / 10, airPm % 10, waitPm / 10, waitPm % 10);
+}
+
 /*
  * printTestResults(): Print LoRaWan communication test
  *
@@ -90,17 +221,204 @@ printTestResults(int count){
 	sLoRaResutls_t * trn = &testResults[0]; // Initialize results pointer
 
 	// for printing
-	char buf[128];
+	char buf[192];
 
 	debugSerial.print(prtSttResults);
 	for (int i = 1; i<= min(TST_MXRSLT, count); i++, trn++){
-		sprintf(buf, "%02d;%07lu;%07lu;%06lu.%03u;%06lu.%03u;%06lu.%03u;0x%02X;%lu;%02u;%02d;%03d;%03d",
+		sprintf(buf, "%02d;%07" PRIu32 ";%07" PRIu32 ";%06" PRIu32 ".%03u;%06" PRIu32 ".%03u;%06" PRIu32 ".%03u;0x%02X;%" PRIu32 ";%02u;%02d;%03d;%03d;%06" PRIu32 ".%03u;%06" PRIu32 ".%03u;%06" PRIu32 ".%03u;%08" PRIX32,
 				i, trn->testTime, trn->txCount,
-				trn->timeTx/1000,	(uint16_t)trn->timeTx%1000,
-				trn->timeRx/1000,	(uint16_t)trn->timeRx%1000,
-				trn->timeToRx/1000, (uint16_t)trn->timeToRx%1000,
+				trn->timeTx/1000,	(uint16_t)(trn->timeTx%1000),
+				trn->timeRx/1000,	(uint16_t)(trn->timeRx%1000),
+				trn->timeToRx/1000, (uint16_t)(trn->timeToRx%1000),
 				trn->chnMsk, trn->txFrq, trn->txDR, trn->txPwr,
-				trn->rxRssi, trn->rxSnr);
+				trn->rxRssi, trn->rxSnr,
+				trn->timeHost/1000, (uint16_t)(trn->timeHost%1000),
+				trn->timeUart/1000, (uint16_t)(trn->timeUart%1000),
+				trn->timeModem/1000, (uint16_t)(trn->timeModem%1000),
+				trn->paySeed);
+		sprintf(buf + strlen(buf), ";%u;%" PRIu32, trn->delivered, trn->rxCount);
+		printEfficiency(buf, (trn->delivered) ? trn->dataLen : 0, trn->testTime,
+				trn->timeAir, trn->timeWait);
+		sprintf(buf + strlen(buf), ";%u", trn->dataLen);
+		debugSerial.println(buf);
+	}
+}
+
+/*
+ * printHistogram(): Print distribution summary of a histogram
+ *
+ * Arguments:	- name of the histogram
+ * 				- histogram to print
+ *
+ * Return:		-
+ */
+static void
+printHistogram(const char * name, const sHistogram_t * hist){
+	char buf[128];
+
+	sprintf(buf, "%s;%07" PRIu32 ";%" PRId32 ";%" PRId32 ";%" PRId32 ";%" PRId32 ";%" PRId32 ";%" PRId32,
+			name, hist->count,
+			(hist->count) ? hist->min : 0, histMean(hist),
+			histPercentile(hist, 50), histPercentile(hist, 90),
+			histPercentile(hist, 99), (hist->count) ? hist->max : 0);
+	debugSerial.println(buf);
+}
+
+/*
+ * printTestStats(): Print LoRaWan run statistics, count;min;mean;p50;p90;p99;max
+ *
+ * Arguments:	-
+ *
+ * Return:		-
+ */
+static void
+printTestStats(){
+	const sLoRaStatistics_t * stats = NULL;
+	if (LoRaMgmtGetStats(&stats))
+		return;
+
+	debugSerial.print(prtSttStats);
+	printHistogram(prtHstTTx, &stats->timeTx);
+	printHistogram(prtHstTToRx, &stats->timeToRx);
+	printHistogram(prtHstTRx, &stats->timeRx);
+	printHistogram(prtHstRssi, &stats->rxRssi);
+	printHistogram(prtHstSnr, &stats->rxSnr);
+
+	char buf[128];
+	if (newConf.mode == 6){
+		// PER;testId;expected;received;lost;duplicates;corrupted;PER %;RSSI mean;SNR mean
+		for (int i = 0; i < stats->perCount; i++){
+			const sLoRaPer_t * per = &stats->per[i];
+			uint32_t expected = per->lastSeq + 1;	// frames before the first received are lost
+			uint32_t unique = per->received - per->duplicates;
+			uint32_t lost = (expected > unique) ? expected - unique : 0;
+			uint32_t rate = (uint32_t)((uint64_t)(lost + per->corrupted) * 10000 / expected);
+			sprintf(buf, "%s;%u;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32 ".%02" PRIu32 ";%" PRId32 ";%" PRId32,
+					prtHstPer, per->testId, expected, per->received, lost,
+					per->duplicates, per->corrupted, rate / 100, rate % 100,
+					per->rssiSum / (int32_t)per->received, per->snrSum / (int32_t)per->received);
+			debugSerial.println(buf);
+		}
+		sprintf(buf, "%s;NoHeader;%" PRIu32, prtHstPer, stats->perNoHdr);
+		debugSerial.println(buf);
+		return;
+	}
+
+	if (newConf.mode == 8){
+		// Scan;index;frequency;samples;busy %;RSSI mean;RSSI max;bins from LORASCANMIN
+		for (int i = 0; i < LORASCANCHN; i++){
+			const sLoRaScan_t * chn = &stats->scan[i];
+			if (!chn->samples)
+				continue;
+			uint32_t occ = (uint32_t)((uint64_t)chn->busy * 10000 / chn->samples);
+			int n = sprintf(buf, "%s;%d;%u;%" PRIu32 ";%" PRIu32 ".%02" PRIu32 ";%" PRId32 ";%d",
+					prtHstScan, i, chn->frequency, chn->samples, occ / 100, occ % 100,
+					(int32_t)(chn->rssiSum / (int64_t)chn->samples), chn->rssiMax);
+			for (int j = 0; j < LORASCANBINS; j++)
+				n += sprintf(&buf[n], ";%" PRIu32, chn->bins[j]);
+			debugSerial.println(buf);
+		}
+		sprintf(buf, "%sMask;0x%02X", prtHstScan, stats->scanMsk);
+		debugSerial.println(buf);
+		return;
+	}
+
+	if (newConf.mode == 7){
+		// RFTest;test;timeouts;RX errors
+		sprintf(buf, "%s;%u;%" PRIu32 ";%" PRIu32, prtHstRfTest, newConf.rfTest,
+				stats->rfTimeout, stats->rfRxError);
+		debugSerial.println(buf);
+		return;
+	}
+
+	if (MD_LORAWAN(newConf.mode)){
+		// frame counters, FCnt;next uplink;last downlink;downlinks;downlinks lost
+		sprintf(buf, "FCnt;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32, stats->fcu,
+				stats->fcd, stats->fcdRx, stats->fcdLost);
+		debugSerial.println(buf);
+	}
+
+	if (MD_LORAWAN(newConf.mode) && !(newConf.confMsk & CM_UCNF))
+		// time-to-ACK per DR, AckEst;DR;samples;mean ms;deviation ms;checks without ACK;late
+		for (int i = 0; i < LORAACKDR; i++){
+			const sLoRaAckEst_t * est = &stats->ackEst[i];
+			if (!est->samples && !est->early)
+				continue;
+			sprintf(buf, "AckEst;%d;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32, i,
+					est->samples, est->srtt >> 3, est->rttvar >> 2, est->early, est->late);
+			debugSerial.println(buf);
+		}
+
+	if (MD_LORAWAN(newConf.mode)){
+		// realised traffic, inter-arrival times and lag behind the schedule, in ms
+		printHistogram(prtHstArrGap, &stats->arrGap);
+		if (newConf.arrival != AP_NONE)
+			printHistogram(prtHstArrLag, &stats->arrLag);
+
+		// Goodput;tests;delivered;PDR%;ACK%;B/s;AT%;radio%;wait%, over the run wall time
+		const sLoRaGoodput_t * run = &stats->run;
+		uint32_t pdr = perMille(run->delivered, run->tests), ack = perMille(run->rxCount, run->txCount);
+		sprintf(buf, "Goodput;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ".%" PRIu32 ";%" PRIu32 ".%" PRIu32,
+				run->tests, run->delivered, pdr / 10, pdr % 10, ack / 10, ack % 10);
+		printEfficiency(buf, run->bytes, run->runTime, run->timeAir, run->timeWait);
+		debugSerial.println(buf);
+	}
+
+	if (MD_LORAWAN(newConf.mode) && (stats->synced || newConf.slotLen)){
+		// Slot;synchronized;start delay ms;slot length ms;slot;slots;slotted sends;slot wait ms
+		sprintf(buf, "Slot;%u;%" PRId32 ";%u;%u;%u;%" PRIu32 ";%" PRIu32, stats->synced,
+				stats->syncDelay, newConf.slotLen, newConf.slotIdx, newConf.slotCount,
+				stats->slotSends, (uint32_t)stats->slotWait);
+		debugSerial.println(buf);
+	}
+
+	if (MD_LORAWAN(newConf.mode))
+		// retries per back-off policy, Retry;policy;tests;delivered;recovered;given up;retries;back-off ms
+		for (int i = 0; i < RP_COUNT; i++){
+			const sLoRaRetry_t * rs = &stats->retry[i];
+			if (!rs->tests && !rs->retries)
+				continue;
+			sprintf(buf, "Retry;%d;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32, i,
+					rs->tests, rs->delivered, rs->recovered, rs->givenUp, rs->retries,
+					(uint32_t)rs->waitTime);
+			debugSerial.println(buf);
+		}
+
+	if (MD_LORAWAN(newConf.mode) && !(newConf.confMsk & CM_OTAA)){
+		// Id;index;device address;next frame counter;uplinks;acknowledged;failed
+		const sLoRaIdentity_t * ids = NULL;
+		int cnt = LoRaMgmtGetIds(&ids);
+		for (int i = 0; i < cnt; i++){
+			sprintf(buf, "%s;%d;%02X%02X%02X%02X;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu32,
+					prtHstId, i, ids[i].devAddr[0], ids[i].devAddr[1], ids[i].devAddr[2],
+					ids[i].devAddr[3], ids[i].fcu, ids[i].txCount, ids[i].acked, ids[i].failed);
+			debugSerial.println(buf);
+		}
+	}
+
+	if (newConf.mode != 1)
+		return;
+
+	printHistogram(prtHstTGap, &stats->txGap);
+	// channel occupancy, air time / wall time
+	uint32_t occ = (stats->wallTime) ? (uint32_t)(stats->airTime * 10000 / stats->wallTime) : 0;
+	sprintf(buf, "Occupancy;%" PRIu32 ";%" PRIu32 ";%" PRIu32 ".%02" PRIu32,
+			(uint32_t)(stats->airTime / 1000), (uint32_t)(stats->wallTime / 1000),
+			occ / 100, occ % 100);
+	debugSerial.println(buf);
+
+	// listen before talk, LBT;frames deferred;back-offs;busy ms
+	if (newConf.confMsk & CM_LBT){
+		sprintf(buf, "LBT;%" PRIu32 ";%" PRIu32 ";%" PRIu32, stats->lbtFrames,
+				stats->lbtDefer, (uint32_t)(stats->lbtBusyTime / 1000));
+		debugSerial.println(buf);
+	}
+
+	// transmissions per hop table entry, hop;index;frequency;SF;BW;CR;count
+	for (int i = 0; i < newConf.hopCount; i++){
+		sprintf(buf, "%s;%d;%u;%u;%u;%u;%" PRIu32, prtHstHop, i,
+				newConf.hops[i].frequency, newConf.hops[i].spreadFactor,
+				newConf.hops[i].bandWidth, newConf.hops[i].codeRate, stats->hopTx[i]);
 		debugSerial.println(buf);
 	}
 }
@@ -189,6 +507,23 @@ readSerialH(){
 	return retVal;
 }
 
+/*
+ * modeOption(): check a mode specific menu option against the selected mode
+ *
+ * Arguments:	- option key
+ * 				- true if the option applies to the selected mode
+ *
+ * Return:		- the validity, prints a message if invalid
+ */
+static bool
+modeOption(char key, bool valid){
+	if (!valid){
+		debugSerial.print("Option not available in this mode ");
+		debugSerial.println(key);
+	}
+	return valid;
+}
+
 /*
  * readSerialD(): parsing numeric input strings
  *
@@ -202,7 +537,7 @@ readSerialD(){
 	uint16_t retVal = 0;
 	while ((A = debugSerial.peek())
 			&& (A < 58 && A >= 48)){
-		if (log10((double)retVal) >= 4.0f ){
+		if (retVal >= 10000){
 			debugSerial.println("Error: too long value!");
 			break;
 		}
@@ -212,16 +547,846 @@ readSerialD(){
 	return retVal;
 }
 
+/*
+ * setKeyPointers(): point key strings of the configuration to the key buffer
+ *
+ * Arguments:	-
+ *
+ * Return:		-
+ */
 static void
-resetKeyBuffer(){
-	memset(keyArray, 0, KEYBUFF );
-
+setKeyPointers(){
 	// key slots are the same for OTAA and ABP (union)
 	newConf.appEui = &(keyArray[0]);			// Hex 32
 	newConf.appKey = &(keyArray[KEYSIZE+1]);	// Hex 32
 	newConf.devEui = &(keyArray[KEYSIZE*2+2]);	// Hex 8 or 16
 }
 
+static void
+resetKeyBuffer(){
+	memset(keyArray, 0, KEYBUFF );
+	setKeyPointers();
+}
+
+/*
+ * setTestMode(): set test mode and its default settings and callbacks
+ *
+ * Arguments:	- configuration to change
+ * 				- test mode [0-4]
+ *
+ * Return:		- 0 if OK, -1 invalid mode, set to 0
+ */
+static int
+setTestMode(sLoRaConfiguration_t * conf, uint8_t mode){
+	int ret = 0;
+	conf->mode = mode;
+	if (conf->mode > 8){
+		conf->mode = 0; // set to default
+		ret = -1;
+	}
+	conf->confMsk &= ~CM_RJN;
+	conf->hopCount = 0;
+	switch (conf->mode)
+	{
+	default:
+	case 0 : // off- mute
+		conf->prep = NULL;
+		conf->start = NULL;
+		conf->run = NULL;
+		break;
+	case 1 : // dumb LoRa
+	case 5 : // LoRa sniffer
+	case 6 : // LoRa PER receiver
+	case 7 : // modem RF test
+	case 8 : // channel scanner
+		conf->prep = NULL;
+		conf->start = NULL;
+		conf->run = (conf->mode == 1) ? &LoRaMgmtSendDumb
+				: (conf->mode == 7) ? &LoRaMgmtRfTest
+				: (conf->mode == 8) ? &LoRaMgmtScan : &LoRaMgmtSniff;
+		conf->frequency = 8683;
+		conf->bandWidth = (conf->mode == 8) ? 125 : 250;	// scan with LoRaWan channel width
+		conf->codeRate = 8;
+		conf->spreadFactor = 12;
+		conf->preamble = 8;
+		break;
+	case 2 :  // LoRaWan
+		conf->prep = NULL;
+		conf->start = &LoRaMgmtSend;
+		conf->run = &LoRaMgmtPoll;
+		break;
+	case 3 : // LoRaRemote
+		conf->prep = &LoRaMgmtRemote;
+		conf->start = &LoRaMgmtSend;
+		conf->run = &LoRaMgmtPoll;
+		break;
+	case 4 : // LoRaWan force Join
+		conf->prep = NULL;
+		conf->start = NULL;
+		conf->run = &LoRaMgmtJoin;
+		conf->confMsk |= CM_RJN;
+		break;
+	}
+	return ret;
+}
+
+/*
+ * isValidBw(): check LoRa bandwidth setting
+ *
+ * Arguments:	- bandwidth in kHz
+ *
+ * Return:		- true if valid
+ */
+static bool
+isValidBw(uint16_t bw){
+	return (bw == 250 || bw == 125 || bw == 62 || bw == 41
+			|| bw == 31 || bw == 20 || bw == 15 || bw == 10);
+}
+
+/*
+ * isConfigComplete(): check if a configuration can be run
+ *
+ * Arguments:	- configuration to check
+ *
+ * Return:		- true if complete
+ */
+static bool
+isConfigComplete(const sLoRaConfiguration_t * conf){
+	return !((MD_RADIO(conf->mode) && conf->frequency == 0) ||
+			(MD_LORAWAN(conf->mode) && (!conf->devAddr ||
+								 !conf->appEui ||
+								 !conf->appKey)));
+}
+
+/*************** BINARY CONFIGURATION *****************/
+
+/*
+ * hexEncode(): convert binary key to a terminated upper case hex string
+ *
+ * Arguments:	- destination string, 2*len+1 chars
+ * 				- binary key
+ * 				- length of key in bytes
+ *
+ * Return:		-
+ */
+static void
+hexEncode(char * dst, const uint8_t * src, uint8_t len){
+	static const char hex[] = "0123456789ABCDEF";
+	while (len--){
+		*dst++ = hex[*src >> 4];
+		*dst++ = hex[*src++ & 0x0F];
+	}
+	*dst = '\0';
+}
+
+/*
+ * parseConfig(): apply TLV configuration entries to a configuration copy
+ *
+ * Arguments:	- TLV payload
+ * 				- payload length
+ * 				- configuration to change
+ * 				- key buffer to change, KEYBUFF chars
+ * 				- pointer to store the offending tag
+ * 				- pointer to store the run request
+ *
+ * Return:		- FRAME_EOK if OK, frame error code otherwise
+ */
+static int
+parseConfig(const uint8_t * buf, uint8_t len, sLoRaConfiguration_t * conf, char * keys, uint8_t * tag, bool * run){
+	const uint8_t * end = buf + len;
+
+	while (buf < end){
+		if (end - buf < 2)
+			return FRAME_ETAG;
+		*tag = buf[0];
+		uint8_t tLen = buf[1];
+		const uint8_t * val = &buf[2];
+		buf += 2 + tLen;
+		if (buf > end)
+			return FRAME_ETAG;
+
+		// value for fixed size tags, little endian
+		uint16_t v = (tLen >= 1) ? val[0] : 0;
+		if (tLen >= 2)
+			v |= (uint16_t)val[1] << 8;
+
+		switch (*tag){
+		case CFG_MODE:
+			if (tLen != 1)
+				return FRAME_ETAG;
+			if (setTestMode(conf, (uint8_t)v))
+				return FRAME_EVAL;
+			memset(keys, 0, KEYBUFF);
+			break;
+
+		case CFG_CONFMSK: // rejoin is controlled by the mode
+			if (tLen != 1)
+				return FRAME_ETAG;
+			conf->confMsk = (uint8_t)((v & ~CM_RJN) | (conf->confMsk & CM_RJN));
+			break;
+
+		case CFG_POWER:
+			if (tLen != 1)
+				return FRAME_ETAG;
+			if (v > 5) //TODO: this is limiting to EU868
+				return FRAME_EVAL;
+			conf->txPowerTst = (uint8_t)v;
+			break;
+
+		case CFG_DATALEN:
+			if (tLen != 1)
+				return FRAME_ETAG;
+			if (v > MAXLORALEN)	// payload buffer size, also the LoRaWan maximum
+				return FRAME_EVAL;
+			conf->dataLen = (uint8_t)v;
+			break;
+
+		case CFG_REPEAT:
+			if (tLen != 1)
+				return FRAME_ETAG;
+			if (v > 100)
+				return FRAME_EVAL;
+			conf->repeatSend = (uint8_t)v;
+			break;
+
+		case CFG_RXWIN1:
+			if (tLen != 2)
+				return FRAME_ETAG;
+			if (v < 1000 || v > 15000)
+				return FRAME_EVAL;
+			conf->rxWindow1 = v;
+			conf->rxWindow2 = v + 1000; // set to default offset (hc in fw)
+			break;
+
+		case CFG_FRQMSK:
+			if (tLen != 2)
+				return FRAME_ETAG;
+			if ((MD_RADIO(conf->mode) && (v < 8630 || v > 8700))
+					|| (MD_LORAWAN(conf->mode) && v > 0xFF))
+				return FRAME_EVAL;
+			conf->frequency = v;
+			break;
+
+		case CFG_DRSF:
+			if (tLen != 1)
+				return FRAME_ETAG;
+			if ((MD_RADIO(conf->mode) && (v < 7 || v > 12))
+					|| (MD_LORAWAN(conf->mode) && v > 5 && v != 255))
+				return FRAME_EVAL;
+			conf->dataRate = (uint8_t)v;
+			break;
+
+		case CFG_BW:
+			if (tLen != 1 || !MD_RADIO(conf->mode))
+				return FRAME_ETAG;
+			if (!isValidBw(v))
+				return FRAME_EVAL;
+			conf->bandWidth = (uint8_t)v;
+			break;
+
+		case CFG_CR:
+			if (tLen != 1 || !MD_RADIO(conf->mode))
+				return FRAME_ETAG;
+			if (v < 5 || v > 8)
+				return FRAME_EVAL;
+			conf->codeRate = (uint8_t)v;
+			break;
+
+		case CFG_PREAMB:
+			if (tLen != 2 || !MD_LORA(conf->mode))
+				return FRAME_ETAG;
+			conf->preamble = v;
+			break;
+
+		case CFG_PAYMODE:
+			if (tLen != 1)
+				return FRAME_ETAG;
+			if (v > PM_SENSOR)
+				return FRAME_EVAL;
+			conf->payMode = (uint8_t)v;
+			break;
+
+		case CFG_SEED:
+			if (tLen != 4)
+				return FRAME_ETAG;
+			conf->paySeed = v | (uint32_t)val[2] << 16 | (uint32_t)val[3] << 24;
+			break;
+
+		case CFG_TESTID:
+			if (tLen != 2)
+				return FRAME_ETAG;
+			conf->testId = v;
+			break;
+
+		case CFG_HOPS:
+			if (tLen % 5 || tLen > LORAHOPMAX * 5 || conf->mode != 1)	// only mode 1 sends
+				return FRAME_ETAG;
+			for (uint8_t i = 0; i < tLen; i += 5){
+				sLoRaHop_t hop = { (uint16_t)(val[i] | val[i+1] << 8), val[i+2], val[i+3], val[i+4] };
+				if (hop.frequency < 8630 || hop.frequency > 8700
+						|| hop.spreadFactor < 7 || hop.spreadFactor > 12
+						|| !isValidBw(hop.bandWidth)
+						|| hop.codeRate < 5 || hop.codeRate > 8)
+					return FRAME_EVAL;
+				conf->hops[i / 5] = hop;
+			}
+			conf->hopCount = tLen / 5;
+			break;
+
+		case CFG_KEY1:
+			if ((tLen != KEYSIZE/4 && tLen != KEYSIZE/2) || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			hexEncode(&keys[0], val, tLen);
+			break;
+
+		case CFG_KEY2:
+			if (tLen != KEYSIZE/2 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			hexEncode(&keys[KEYSIZE+1], val, tLen);
+			break;
+
+		case CFG_KEY3:
+			if ((tLen != KEYSIZE/8 && tLen != KEYSIZE/4) || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			hexEncode(&keys[KEYSIZE*2+2], val, tLen);
+			break;
+
+		case CFG_RFTEST:
+			if (tLen != 1 || conf->mode != 7)
+				return FRAME_ETAG;
+			if (v > RT_TONE)
+				return FRAME_EVAL;
+			conf->rfTest = (uint8_t)v;
+			break;
+
+		case CFG_RFCOUNT:
+			if (tLen != 2 || conf->mode != 7)
+				return FRAME_ETAG;
+			if (v == 0)
+				return FRAME_EVAL;
+			conf->rfCount = v;
+			break;
+
+		case CFG_SCANDWL:
+			if (tLen != 2 || conf->mode != 8)
+				return FRAME_ETAG;
+			if (v == 0)
+				return FRAME_EVAL;
+			conf->scanDwell = v;
+			break;
+
+		case CFG_BUSYLVL:
+			if (tLen != 1 || (conf->mode != 1 && conf->mode != 8))
+				return FRAME_ETAG;
+			if (v > 128)
+				return FRAME_EVAL;
+			conf->busyLevel = (int8_t)-(int)v;
+			break;
+
+		case CFG_LBTBOFF:
+			if (tLen != 2 || conf->mode != 1)
+				return FRAME_ETAG;
+			conf->lbtBackoff = v;
+			break;
+
+		case CFG_RTRPOL:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v >= RP_COUNT)
+				return FRAME_EVAL;
+			conf->retryPolicy = (uint8_t)v;
+			break;
+
+		case CFG_RTRDLY:
+			if (tLen != 2 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			conf->retryDelay = v;
+			break;
+
+		case CFG_ARRIVAL:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v >= AP_COUNT)
+				return FRAME_EVAL;
+			conf->arrival = (uint8_t)v;
+			break;
+
+		case CFG_ARRPER:
+			if (tLen != 2 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			conf->arrPeriod = v;
+			break;
+
+		case CFG_ARRJIT:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v > 100)
+				return FRAME_EVAL;
+			conf->arrJitter = (uint8_t)v;
+			break;
+
+		case CFG_BURSTLN:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v == 0)
+				return FRAME_EVAL;
+			conf->burstLen = (uint8_t)v;
+			break;
+
+		case CFG_LENDIST:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v >= LD_COUNT)
+				return FRAME_EVAL;
+			conf->lenDist = (uint8_t)v;
+			break;
+
+		case CFG_LENMIN:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v == 0)
+				return FRAME_EVAL;
+			conf->lenMin = (uint8_t)v;
+			break;
+
+		case CFG_SLOTLEN:
+			if (tLen != 2 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			conf->slotLen = v;
+			break;
+
+		case CFG_SLOTIDX:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			conf->slotIdx = (uint8_t)v;
+			break;
+
+		case CFG_SLOTCNT:
+			if (tLen != 1 || !MD_LORAWAN(conf->mode))
+				return FRAME_ETAG;
+			if (v == 0)
+				return FRAME_EVAL;
+			conf->slotCount = (uint8_t)v;
+			break;
+
+		case CFG_RMTLSTN:
+			if (tLen != 1 || conf->mode != 3)
+				return FRAME_ETAG;
+			if (v > 1)
+				return FRAME_EVAL;
+			conf->rmtListen = (uint8_t)v;
+			break;
+
+		case CFG_RUN:
+			if (tLen != 0)
+				return FRAME_ETAG;
+			*run = true;
+			break;
+
+		default:
+			return FRAME_ETAG;
+		}
+	}
+
+	*tag = 0;
+	// key lengths must match join type, EUI 8 bytes for OTAA, session key 16 bytes for ABP
+	if (MD_LORAWAN(conf->mode) && keys[0] != '\0'
+			&& (strlen(&keys[0]) == KEYSIZE/2) != !!(conf->confMsk & CM_OTAA)){
+		*tag = CFG_KEY1;
+		return FRAME_EVAL;
+	}
+	return FRAME_EOK;
+}
+
+/*
+ * applyConfig(): apply TLV configuration entries atomically
+ *
+ * Arguments:	- TLV payload
+ * 				- payload length
+ * 				- configuration to change, unchanged on error
+ * 				- key buffer to change, unchanged on error
+ * 				- pointer to store the offending tag
+ * 				- pointer to store the run request
+ *
+ * Return:		- FRAME_EOK if OK, frame error code otherwise
+ */
+static int
+applyConfig(const uint8_t * buf, uint8_t len, sLoRaConfiguration_t * conf, char * keys, uint8_t * tag, bool * run){
+	// work on copies, commit only if all entries are valid
+	sLoRaConfiguration_t tmpConf = *conf;
+	char tmpKeys[KEYBUFF];
+	memcpy(tmpKeys, keys, KEYBUFF);
+
+	int ret = parseConfig(buf, len, &tmpConf, tmpKeys, tag, run);
+	if (ret == FRAME_EOK){
+		*conf = tmpConf;
+		memcpy(keys, tmpKeys, KEYBUFF);
+	}
+	return ret;
+}
+
+/*
+ * setCampaignBase(): on first upload, the current configuration becomes the base of the campaign
+ *
+ * Arguments:	-
+ *
+ * Return:		-
+ */
+static void
+setCampaignBase(){
+	if (cfgQueueLen || swpCount)
+		return;
+
+	cfgBase = newConf;
+	memcpy(cfgBaseKeys, keyArray, KEYBUFF);
+	cfgShadow = newConf;
+	memcpy(cfgShadowKeys, keyArray, KEYBUFF);
+}
+
+/*
+ * sweepValue(): get a value of a sweep axis
+ *
+ * Arguments:	- sweep axis
+ * 				- list values of the descriptor
+ * 				- value index
+ *
+ * Return:		- value
+ */
+static uint16_t
+sweepValue(const sSweepAxis_t * axis, const uint16_t * list, uint16_t idx){
+	if (axis->step)
+		return (uint16_t)(axis->start + idx * axis->step);
+	return list[axis->start + idx];
+}
+
+/*
+ * sweepEntry(): write a sweep axis value as TLV entry
+ *
+ * Arguments:	- destination buffer, 4 bytes
+ * 				- sweep axis
+ * 				- list values of the descriptor
+ * 				- value index
+ *
+ * Return:		- bytes written
+ */
+static uint8_t
+sweepEntry(uint8_t * buf, const sSweepAxis_t * axis, const uint16_t * list, uint16_t idx){
+	uint16_t value = sweepValue(axis, list, idx);
+	buf[0] = axis->tag;
+	buf[1] = axis->size;
+	buf[2] = (uint8_t)value;
+	buf[3] = (uint8_t)(value >> 8);
+	return (uint8_t)(2 + axis->size);
+}
+
+/*
+ * sweepValidate(): check all sweep values on top of a configuration
+ *
+ * Arguments:	- configuration to validate against
+ * 				- keys of that configuration
+ * 				- sweep axes
+ * 				- number of axes
+ * 				- list values of the list axes
+ * 				- pointer to store the offending tag
+ *
+ * Return:		- FRAME_EOK if OK, frame error code otherwise
+ */
+static int
+sweepValidate(const sLoRaConfiguration_t * base, char * keys, const sSweepAxis_t * axes,
+		uint8_t cnt, const uint16_t * list, uint8_t * tag){
+	for (uint8_t i = 0; i < cnt; i++){
+		sLoRaConfiguration_t conf = *base;
+		bool run = false;
+		uint8_t entry[4];
+		for (uint16_t j = 0; j < axes[i].count; j++){
+			int ret = parseConfig(entry, sweepEntry(entry, &axes[i], list, j), &conf, keys, tag, &run);
+			if (ret != FRAME_EOK){
+				*tag = axes[i].tag;
+				return ret;
+			}
+		}
+	}
+	return FRAME_EOK;
+}
+
+/*
+ * queueConfig(): append TLV configuration to the queue, validated on top of the previous entries
+ *
+ * Arguments:	- TLV payload, empty clears the queue
+ * 				- payload length
+ * 				- pointer to store the offending tag
+ *
+ * Return:		- FRAME_EOK if OK, frame error code otherwise, also if the sweep is no longer valid
+ */
+static int
+queueConfig(const uint8_t * buf, uint8_t len, uint8_t * tag){
+	bool run = false;
+
+	if (!len){
+		cfgQueueLen = 0;
+		cfgShadow = cfgBase;
+		memcpy(cfgShadowKeys, cfgBaseKeys, KEYBUFF);
+		// the sweep applies after the queue, drop it if invalid without
+		int ret = sweepValidate(&cfgShadow, cfgShadowKeys, swpAxes, swpCount, swpList, tag);
+		if (ret != FRAME_EOK)
+			swpCount = 0;
+		return ret;
+	}
+	if (cfgQueueLen + len + 1 > CFG_QUEUESZ)
+		return FRAME_EFULL;
+
+	setCampaignBase();
+
+	sLoRaConfiguration_t shadow = cfgShadow;
+	char shadowKeys[KEYBUFF];
+	memcpy(shadowKeys, cfgShadowKeys, KEYBUFF);
+
+	int ret = applyConfig(buf, len, &shadow, shadowKeys, tag, &run);
+	if (ret == FRAME_EOK)	// the sweep must stay valid on top of the new entry
+		ret = sweepValidate(&shadow, shadowKeys, swpAxes, swpCount, swpList, tag);
+	if (ret != FRAME_EOK)
+		return ret;
+
+	cfgShadow = shadow;
+	memcpy(cfgShadowKeys, shadowKeys, KEYBUFF);
+
+	cfgQueue[cfgQueueLen++] = len;
+	memcpy(&cfgQueue[cfgQueueLen], buf, len);
+	cfgQueueLen += len;
+	return FRAME_EOK;
+}
+
+/*
+ * cfgTagSize(): value size of a configuration tag usable in sweeps
+ *
+ * Arguments:	- configuration tag
+ *
+ * Return:		- value size in bytes, 0 if not sweepable
+ */
+static uint8_t
+cfgTagSize(uint8_t tag){
+	switch (tag){
+	case CFG_CONFMSK:
+	case CFG_POWER:
+	case CFG_DATALEN:
+	case CFG_REPEAT:
+	case CFG_DRSF:
+	case CFG_BW:
+	case CFG_CR:
+	case CFG_PAYMODE:
+	case CFG_RFTEST:
+	case CFG_BUSYLVL:
+	case CFG_RTRPOL:
+	case CFG_ARRIVAL:
+	case CFG_ARRJIT:
+	case CFG_BURSTLN:
+	case CFG_LENDIST:
+	case CFG_LENMIN:
+	case CFG_SLOTIDX:
+	case CFG_SLOTCNT:
+		return 1;
+	case CFG_RXWIN1:
+	case CFG_FRQMSK:
+	case CFG_PREAMB:
+	case CFG_TESTID:
+	case CFG_RFCOUNT:
+	case CFG_SCANDWL:
+	case CFG_LBTBOFF:
+	case CFG_RTRDLY:
+	case CFG_ARRPER:
+	case CFG_SLOTLEN:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * identityConfig(): append ABP identities to the identity table
+ *
+ * Arguments:	- identities, LORAIDLEN bytes each, empty clears the table
+ * 				- payload length
+ *
+ * Return:		- FRAME_EOK if OK, frame error code otherwise
+ */
+static int
+identityConfig(const uint8_t * buf, uint8_t len){
+	const sLoRaIdentity_t * ids = NULL;
+
+	if (!len){
+		LoRaMgmtIdClear();
+		return FRAME_EOK;
+	}
+	if (len % LORAIDLEN)
+		return FRAME_ETAG;
+	if (LoRaMgmtGetIds(&ids) + len / LORAIDLEN > LORAIDMAX)
+		return FRAME_EFULL;
+
+	for (uint8_t i = 0; i < len; i += LORAIDLEN)
+		(void)LoRaMgmtIdAdd(&buf[i]);
+	return FRAME_EOK;
+}
+
+/*
+ * sweepConfig(): set sweep descriptor, all values validated on top of the queued entries
+ *
+ * Arguments:	- descriptor payload, empty clears the sweep
+ * 				- payload length
+ * 				- pointer to store the offending tag
+ *
+ * Return:		- FRAME_EOK if OK, frame error code otherwise
+ */
+static int
+sweepConfig(const uint8_t * buf, uint8_t len, uint8_t * tag){
+	sSweepAxis_t axes[CFG_SWPAXES];
+	uint16_t list[FRAME_MAXLEN/2];
+	uint8_t cnt = 0;
+	uint16_t lCnt = 0;
+	const uint8_t * end = buf + len;
+
+	while (buf < end){
+		if (cnt >= CFG_SWPAXES || end - buf < 3)
+			return FRAME_ETAG;
+
+		sSweepAxis_t * axis = &axes[cnt++];
+		*tag = axis->tag = buf[0];
+		if (!(axis->size = cfgTagSize(axis->tag)))
+			return FRAME_ETAG;
+		axis->pos = 0;
+
+		if (buf[1] == CFG_SWPRNG){
+			if (end - buf < 8)
+				return FRAME_ETAG;
+			uint16_t stop = (uint16_t)(buf[4] | buf[5] << 8);
+			axis->start = (uint16_t)(buf[2] | buf[3] << 8);
+			axis->step = (uint16_t)(buf[6] | buf[7] << 8);
+			if (!axis->step || stop < axis->start)
+				return FRAME_EVAL;
+			uint32_t count = (uint32_t)(stop - axis->start) / axis->step + 1;
+			if (!count || count > UINT16_MAX)
+				return FRAME_EVAL;
+			axis->count = (uint16_t)count;
+			buf += 8;
+		}
+		else if (buf[1] == CFG_SWPLST){
+			axis->count = buf[2];
+			axis->start = lCnt;
+			axis->step = 0;
+			buf += 3;
+			if (!axis->count || end - buf < 2 * axis->count)
+				return FRAME_ETAG;
+			for (uint16_t i = 0; i < axis->count; i++, buf += 2)
+				list[lCnt++] = (uint16_t)(buf[0] | buf[1] << 8);
+		}
+		else
+			return FRAME_ETAG;
+	}
+
+	if (!cnt){
+		swpCount = 0;
+		return FRAME_EOK;
+	}
+
+	setCampaignBase();
+
+	// every value must be valid on top of the queued configuration
+	int ret = sweepValidate(&cfgShadow, cfgShadowKeys, axes, cnt, list, tag);
+	if (ret != FRAME_EOK)
+		return ret;
+
+	memcpy(swpAxes, axes, sizeof(axes[0]) * cnt);
+	memcpy(swpList, list, sizeof(list[0]) * lCnt);
+	swpCount = cnt;
+	return FRAME_EOK;
+}
+
+/*
+ * loadSweepConfig(): apply the next sweep combination to the test configuration
+ *
+ * Arguments:	-
+ *
+ * Return:		- 1 if loaded, 0 if no more combinations, -1 on error
+ */
+static int
+loadSweepConfig(){
+	uint8_t buf[CFG_SWPAXES * 4];
+	uint8_t len = 0;
+	uint8_t tag = 0;
+	bool run = false;
+
+	if (!swpCount || swpDone)
+		return 0;
+
+	for (uint8_t i = 0; i < swpCount; i++)
+		len += sweepEntry(&buf[len], &swpAxes[i], swpList, swpAxes[i].pos);
+
+	// advance odometer, last axis fastest
+	swpDone = true;
+	for (int i = swpCount - 1; i >= 0; i--){
+		if (++swpAxes[i].pos < swpAxes[i].count){
+			swpDone = false;
+			break;
+		}
+		swpAxes[i].pos = 0;
+	}
+
+	if (applyConfig(buf, len, &newConf, keyArray, &tag, &run) != FRAME_EOK)
+		return -1;
+	cfgIndex++;
+	return 1;
+}
+
+/*
+ * loadNextConfig(): apply the next queued configuration to the test configuration
+ *
+ * Arguments:	-
+ *
+ * Return:		- 1 if loaded, 0 if no more entries, -1 on error
+ */
+static int
+loadNextConfig(){
+	uint8_t tag = 0;
+	bool run = false;
+
+	if (cfgQueuePos >= cfgQueueLen)
+		return loadSweepConfig();
+
+	uint8_t len = cfgQueue[cfgQueuePos];
+	const uint8_t * buf = &cfgQueue[cfgQueuePos+1];
+	cfgQueuePos += len + 1;
+
+	if (applyConfig(buf, len, &newConf, keyArray, &tag, &run) != FRAME_EOK)
+		return -1;
+	if (MD_LORAWAN(newConf.mode))
+		setKeyPointers();
+	cfgIndex++;
+	return 1;
+}
+
+/*
+ * startQueue(): restore campaign base and load the first queued configuration or sweep combination
+ *
+ * Arguments:	-
+ *
+ * Return:		- 1 if loaded, 0 if the queue is empty, -1 on error
+ */
+static int
+startQueue(){
+	cfgQueuePos = 0;
+	cfgIndex = -1;
+	for (uint8_t i = 0; i < swpCount; i++)
+		swpAxes[i].pos = 0;
+	swpDone = false;
+	if (!cfgQueueLen && !swpCount)
+		return 0;
+
+	newConf = cfgBase;
+	memcpy(keyArray, cfgBaseKeys, KEYBUFF);
+	if (MD_LORAWAN(newConf.mode))
+		setKeyPointers();
+	return loadNextConfig();
+}
+
 /*************** TEST MANAGEMENT FUNCTIONS*****************/
 
 // Enumeration for test status
@@ -269,6 +1434,7 @@ runTest(){
 
 		// reset status on next test
 		memset(testResults,0, sizeof(testResults));
+		LoRaMgmtClearStats();
 
 		if (LoRaMgmtSetup(&newConf, &testResults[0]))
 		{
@@ -356,13 +1522,14 @@ runTest(){
 		// unsuccessful and retries left? or retry disabled == until stop
 		if (((failed && retries < newConf.repeatSend)
 				|| 0 == newConf.repeatSend)	&& testReq < qStop){
-			if (LoRaMgmtUpdt()){
+			if (LoRaMgmtUpdt(failed)){
 				tstate = rStart;
 				debugSerial.print(prtSttRetry);
 			}
 			break;
 		}
 
+		LoRaMgmtTestDone(failed);
 		tstate = rEvaluate;
 		debugSerial.print(prtSttEvaluate);
 		// fall-through
@@ -399,12 +1566,39 @@ runTest(){
 				printScaled(trn->timeToRx);
 				debugSerial.print(prtTblTms);
 				debugSerial.println();
+
+				debugSerial.print(prtTblTHst);
+				printScaled(trn->timeHost);
+				debugSerial.print(prtTblTms);
+				debugSerial.print(prtTblTUart);
+				printScaled(trn->timeUart);
+				debugSerial.print(prtTblTms);
+				debugSerial.print(prtTblTMdm);
+				printScaled(trn->timeModem);
+				debugSerial.print(prtTblTms);
+				debugSerial.println();
 			}
 
 			// End of tests?
 			if ((trn >= &testResults[TST_MXRSLT-1]) || (testReq >= qStop)){
 				debugSerial.print(prtSttEnd);
+				if (cfgIndex >= 0){
+					debugSerial.print(prtSttConfig);
+					debugSerial.println(cfgIndex);
+				}
 				printTestResults((trn-&testResults[0])+1); // Typed difference !
+				printTestStats();
+
+				// continue with next queued configuration, if not stopped
+				if (testReq < qStop){
+					if ((ret = loadNextConfig()) > 0){
+						tstate = rInit;
+						break;
+					}
+					else if (ret < 0)
+						debugSerial.print(prtSttErrQueue);
+				}
+
 				tstate = rEnd;
 				testReq = qStop;
 				break;
@@ -455,6 +1649,73 @@ runTest(){
 
 }
 
+/*
+ * startTest(): request a test run, or a campaign run if configurations are queued
+ *
+ * Arguments:	-
+ *
+ * Return:		-
+ */
+static void
+startTest(){
+	if (startQueue() < 0){
+		debugSerial.print(prtSttErrQueue);
+		return;
+	}
+
+	if (newConf.mode == 0) // do nothing
+		return;
+
+	if (!isConfigComplete(&newConf)){
+		debugSerial.println("Incomplete configuration!");
+		return;
+	}
+
+	testReq = qRun;
+}
+
+/*
+ * readConfigFrame(): read a binary frame and apply or queue it, reply with ACK/NAK
+ *
+ * Arguments:	-
+ *
+ * Return:		-
+ */
+static void
+readConfigFrame(){
+	static uint8_t buf[FRAME_MAXLEN];
+	uint8_t type = 0, len = 0, tag = 0;
+	bool run = false;
+
+	int ret = frameRead(debugSerial, &type, buf, &len);
+	if (ret == FRAME_EOK && type != CFG_FRAME && type != CFG_QUEUE && type != CFG_SWEEP
+			&& type != CFG_IDENT)
+		ret = FRAME_ETYPE;
+	if (ret == FRAME_EOK && testReq != qIdle)
+		ret = FRAME_EBUSY;
+
+	if (ret == FRAME_EOK){
+		if (type == CFG_QUEUE)
+			ret = queueConfig(buf, len, &tag);
+		else if (type == CFG_SWEEP)
+			ret = sweepConfig(buf, len, &tag);
+		else if (type == CFG_IDENT)
+			ret = identityConfig(buf, len);
+		else
+			ret = applyConfig(buf, len, &newConf, keyArray, &tag, &run);
+	}
+
+	frameReply(debugSerial, type, (uint8_t)ret, tag);
+	if (ret != FRAME_EOK || type != CFG_FRAME)
+		return;
+
+	if (MD_LORAWAN(newConf.mode))
+		setKeyPointers();
+
+	if (run)
+		startTest();
+}
+
 /*
  * readInput(): read input string
  *
@@ -476,50 +1737,14 @@ void readInput() {
 		case '\r':
 			break;
 
-		case 'm': // read test mode
-			newConf.mode = (uint8_t)readSerialD();
-			if (newConf.mode > 4){
-				debugSerial.println("Invalid mode [0-4]");
-				newConf.mode = 0; // set to default
-			}
-			resetKeyBuffer();
-			newConf.confMsk &= ~CM_RJN;
-			switch (newConf.mode)
-			{
-			default:
-			case 0 : // off- mute
-				newConf.prep = NULL;
-				newConf.start = NULL;
-				newConf.run = NULL;
-				break;
-			case 1 : // dumb LoRa
-				newConf.prep = NULL;
-				newConf.start = NULL;
-				newConf.run = &LoRaMgmtSendDumb;
-				newConf.frequency = 8683;
-				newConf.bandWidth = 250;
-				newConf.codeRate = 8;
-				newConf.spreadFactor = 12;
-				newConf.preamble = 8;
-				break;
-			case 2 :  // LoRaWan
-				newConf.prep = NULL;
-				newConf.start = &LoRaMgmtSend;
-				newConf.run = &LoRaMgmtPoll;
-				break;
-			case 3 : // LoRaRemote
-				newConf.prep = &LoRaMgmtRemote;
-				newConf.start = &LoRaMgmtSend;
-				newConf.run = &LoRaMgmtPoll;
-				break;
-			case 4 : // LoRaWan force Join
-				newConf.prep = NULL;
-				newConf.start = NULL;
-				newConf.run = &LoRaMgmtJoin;
-				newConf.confMsk |= CM_RJN;
-				break;
-			}
+		case FRAME_STX: // binary configuration frame
+			readConfigFrame();
+			break;
 
+		case 'm': // read test mode
+			resetKeyBuffer();	// before mode defaults, keys share the unions
+			if (setTestMode(&newConf, (uint8_t)readSerialD()))
+				debugSerial.println("Invalid mode [0-8]");
 			break;
 
 		case 'p': // read Tx power index
@@ -531,10 +1756,21 @@ void readInput() {
 			break;
 
 		case 'l': // read data length
-			newConf.dataLen = (uint8_t)readSerialD();
-			if (newConf.dataLen > 242 && newConf.mode >=2){ // Maximum LoRaWan application payload
-				debugSerial.println("Invalid data length [0-242]");
-				newConf.dataLen = 1; // set to default
+			{
+				uint16_t v = readSerialD();
+				if (v > MAXLORALEN){ // payload buffer size, also the LoRaWan maximum
+					debugSerial.println("Invalid data length [0-242]");
+					v = 1; // set to default
+				}
+				newConf.dataLen = (uint8_t)v;
+			}
+			break;
+
+		case 'g': // read payload generator mode
+			newConf.payMode = (uint8_t)readSerialD();
+			if (newConf.payMode > PM_SENSOR){
+				debugSerial.println("Invalid payload mode [0-3]");
+				newConf.payMode = PM_RANDOM; // set to default
 			}
 			break;
 
@@ -547,18 +1783,7 @@ void readInput() {
 
 			break;
 		case 'R': // set to run
-			if (newConf.mode == 0) // do nothing
-				break;
-
-			if ((newConf.mode == 1 && newConf.frequency == 0) ||
-				(newConf.mode >= 2 && (!newConf.devAddr ||
-									   !newConf.appEui ||
-									   !newConf.appKey))){
-				debugSerial.println("Incomplete configuration!");
-				break;
-			}
-
-			testReq = qRun;
+			startTest();
 			break;
 
 		case 'S': // stop test
@@ -580,10 +1805,19 @@ void readInput() {
 			}
 			break;
 
+		case 'M': // Print AT transport metrics
+			if (LoRaMgmtPrintMetrics(debugSerial))
+				debugSerial.println("Metrics not available, compile with LORA_METRICS");
+			break;
+
 		case 'B': // Reset/Reboot after each test
 			newConf.confMsk |= CM_RSTMDM;
 			break;
 
+		case 'H': // Test header in payload
+			newConf.confMsk |= CM_PHDR;
+			break;
+
 		case 'n': // disable debug print
 			debug = 0;
 			break;
@@ -591,7 +1825,7 @@ void readInput() {
 			intp = 1;
 		}
 		if (intp){
-			if (newConf.mode == 1){
+			if (MD_RADIO(newConf.mode)){
 				switch (A){
 				case 'f': //TODO: this is limiting to EU868
 					newConf.frequency = (long)readSerialD(); // TODO: 10 vs 100kHz
@@ -603,14 +1837,7 @@ void readInput() {
 
 				case 'b': // read bandwidth
 					newConf.bandWidth = (uint8_t)readSerialD();
-					if (!(newConf.bandWidth == 250 ||
-							newConf.bandWidth == 125 ||
-							newConf.bandWidth == 62 ||
-							newConf.bandWidth == 41 ||
-							newConf.bandWidth == 31 ||
-							newConf.bandWidth == 20 ||
-							newConf.bandWidth == 15 ||
-							newConf.bandWidth == 10 )){
+					if (!isValidBw(newConf.bandWidth)){
 						debugSerial.println("Invalid bandwidth [ 250 | 125 | 62 | 41 | 31 | 20 | 15 | 10 ]");
 						newConf.bandWidth = 250; // set to default
 					}
@@ -636,6 +1863,20 @@ void readInput() {
 					newConf.preamble = readSerialD();
 					break;
 
+				case 'O': // Add current frequency, SF, BW and CR to hop table, mode 1
+					if (!modeOption(A, newConf.mode == 1))
+						break;
+					if (newConf.hopCount >= LORAHOPMAX){
+						debugSerial.println("Hop table full [8]");
+						break;
+					}
+					newConf.hops[newConf.hopCount].frequency = newConf.frequency;
+					newConf.hops[newConf.hopCount].spreadFactor = newConf.spreadFactor;
+					newConf.hops[newConf.hopCount].bandWidth = newConf.bandWidth;
+					newConf.hops[newConf.hopCount].codeRate = newConf.codeRate;
+					newConf.hopCount++;
+					break;
+
 				case 'P': // Set to private network preamble
 					newConf.confMsk |= CM_NPBLK;
 					break;
@@ -652,12 +1893,77 @@ void readInput() {
 					newConf.confMsk |= CM_EXHDR;
 					break;
 
+				case 't': // modem RF test, mode 7
+					{
+						uint16_t v = readSerialD();
+						if (!modeOption(A, newConf.mode == 7))
+							break;
+						if (v > RT_TONE){
+							debugSerial.println("Invalid RF test [0-3]");
+							v = RT_TX; // set to default
+						}
+						newConf.rfTest = (uint8_t)v;
+					}
+					break;
+
+				case 'k': // packets per RF test, mode 7
+					{
+						uint16_t v = readSerialD();
+						if (!modeOption(A, newConf.mode == 7))
+							break;
+						newConf.rfCount = v;
+					}
+					if (newConf.rfCount == 0){
+						debugSerial.println("Invalid packet count [1-9999]");
+						newConf.rfCount = 10; // set to default
+					}
+					break;
+
+				case 'd': // dwell time per channel, mode 8
+					{
+						uint16_t v = readSerialD();
+						if (!modeOption(A, newConf.mode == 8))
+							break;
+						newConf.scanDwell = v;
+					}
+					if (newConf.scanDwell == 0){
+						debugSerial.println("Invalid dwell time [1-9999] ms");
+						newConf.scanDwell = 100; // set to default
+					}
+					break;
+
+				case 'v': // busy RSSI level in -dBm, mode 1 LBT and mode 8
+					{
+						int v = readSerialD();
+						if (!modeOption(A, newConf.mode == 1 || newConf.mode == 8))
+							break;
+						if (v > 128){
+							debugSerial.println("Invalid busy level [0-128] -dBm");
+							v = 100; // set to default
+						}
+						newConf.busyLevel = (int8_t)-v;
+					}
+					break;
+
+				case 'W': // listen before talk, mode 1
+					if (modeOption(A, newConf.mode == 1))
+						newConf.confMsk |= CM_LBT;
+					break;
+
+				case 'w': // LBT max back-off in ms, mode 1
+					{
+						uint16_t v = readSerialD();
+						if (modeOption(A, newConf.mode == 1))
+							newConf.lbtBackoff = v;
+					}
+					break;
+
 				default:
 					debugSerial.print("Unknown command ");
 					debugSerial.println(A);
 				}
 			}
-			else if (newConf.mode >= 2){
+			else if (MD_LORAWAN(newConf.mode)){
 				switch (A){
 
 				case 'c': // set to confirmed
@@ -718,8 +2024,8 @@ void readInput() {
 
 				case 'C':
 					newConf.chnMsk = readSerialH();
-					if (newConf.chnMsk < 0x01 || newConf.chnMsk > 0xFF ){ //TODO: this is limiting to EU868
-						debugSerial.println("Invalid channel mask [0x01-0xFFh]");
+					if (newConf.chnMsk > 0xFF ){ //TODO: this is limiting to EU868, 0 = last scan
+						debugSerial.println("Invalid channel mask [0x00-0xFFh]");
 						newConf.chnMsk = 0xFF; // set to default
 					}
 					break;
@@ -732,6 +2038,83 @@ void readInput() {
 					}
 					break;
 
+				case 'y': // retry back-off policy
+					newConf.retryPolicy = (uint8_t)readSerialD();
+					if (newConf.retryPolicy >= RP_COUNT){
+						debugSerial.println("Invalid retry policy [0-3]");
+						newConf.retryPolicy = RP_NONE; // set to default
+					}
+					break;
+
+				case 'Y': // retry back-off base in ms
+					newConf.retryDelay = (uint16_t)readSerialD();
+					break;
+
+				case 'q': // packet arrival process
+					newConf.arrival = (uint8_t)readSerialD();
+					if (newConf.arrival >= AP_COUNT){
+						debugSerial.println("Invalid arrival process [0-3]");
+						newConf.arrival = AP_NONE; // set to default
+					}
+					break;
+
+				case 'e': // mean inter-arrival time in 100 ms
+					newConf.arrPeriod = (uint16_t)readSerialD();
+					break;
+
+				case 'j': // periodic arrival jitter in percent
+					newConf.arrJitter = (uint8_t)readSerialD();
+					if (newConf.arrJitter > 100){
+						debugSerial.println("Invalid jitter [0-100%]");
+						newConf.arrJitter = 0; // set to default
+					}
+					break;
+
+				case 'k': // packets per burst
+					newConf.burstLen = (uint8_t)readSerialD();
+					if (newConf.burstLen == 0){
+						debugSerial.println("Invalid burst length [1-255]");
+						newConf.burstLen = 5; // set to default
+					}
+					break;
+
+				case 'z': // payload length distribution
+					newConf.lenDist = (uint8_t)readSerialD();
+					if (newConf.lenDist >= LD_COUNT){
+						debugSerial.println("Invalid length distribution [0-2]");
+						newConf.lenDist = LD_FIXED; // set to default
+					}
+					break;
+
+				case 'Z': // shortest payload of the length distribution
+					newConf.lenMin = (uint8_t)readSerialD();
+					if (newConf.lenMin == 0){
+						debugSerial.println("Invalid min length [1-242]");
+						newConf.lenMin = 1; // set to default
+					}
+					break;
+
+				case 'U': // slot length in ms, 0 = pure ALOHA
+					newConf.slotLen = (uint16_t)readSerialD();
+					break;
+
+				case 'V': // slot of the node in the frame
+					newConf.slotIdx = (uint8_t)readSerialD();
+					break;
+
+				case 'W': // slots per frame
+					newConf.slotCount = (uint8_t)readSerialD();
+					if (newConf.slotCount == 0){
+						debugSerial.println("Invalid slot count [1-255]");
+						newConf.slotCount = 1; // set to default
+					}
+					break;
+
+				case 'L': // listen in class C for remote commands, mode 3
+					if (modeOption(A, newConf.mode == 3))
+						newConf.rmtListen = 1;
+					break;
+
 				case 'x': // read window delay RX1 / RX2 (HC)
 					newConf.rxWindow1 = readSerialD();
 					if (newConf.rxWindow1 < 1000 || newConf.rxWindow1 > 15000){ // test range, min 1 sec .. defaults
@@ -770,6 +2153,10 @@ void setup()
 	}
 	debug = ((waitSE));	// reset debug flag if time is elapsed
 
+#ifdef LORA_TRACE
+	LORA_TRACE.begin(LORA_TRACEBAUD);
+#endif
+
 	// Blink once PIN20 to show program start
 	REG_PORT_OUTSET0 = LEDBUILDIN;
 	delay(500);
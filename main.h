@@ -15,6 +15,9 @@
 #define loraSerial SerialLoRa		// Hardware serial
 
 #define LORA_DEBUG 		debugSerial
+//#define LORA_METRICS				// AT transport metrics per command, 'M' to print
+//#define LORA_TRACE		Serial1		// record modem serial traffic to this port, see LoRaTrace.h
+#define LORA_TRACEBAUD	1000000		// trace port baud rate
 #define MICROVER		"MKRWAN_1.0V"
 
 //global variable declarations